@@ -32,10 +32,17 @@
 #ifndef ARRAYACQPROTOCOL_H_
 #define ARRAYACQPROTOCOL_H_
 
+#include "MessageStatistics.h"
 #include "RawBuffer.h"
 
-#include <boost/asio/read.hpp>
-#include <boost/asio/write.hpp>
+#include <algorithm> /* min */
+#include <cstring> /* memcpy, memmove */
+#include <limits>
+#include <memory>
+#include <vector>
+
+#include <boost/asio/buffer.hpp>
+#include <boost/circular_buffer.hpp>
 #include <boost/cstdint.hpp>
 
 #include "Exception.h"
@@ -49,13 +56,51 @@ struct InvalidRequestException : public virtual Exception {};
 struct ServerException : public virtual Exception {};
 
 /*******************************************************************************
+ * Message framing, independent of the transport.
+ *
+ * The received bytes are written to inputBuffer() and announced with
+ * inputReceived(). receiveMessage() extracts the complete messages.
+ * sendMessage() appends the message to the output queue, which is
+ * sent with a gather write using getOutputBuffers() and outputSent().
+ *
+ * Header (big-endian):
+ *     uint32 message type, uint32 data size
+ * Multiplexed header (see setMultiplexed()):
+ *     uint32 message type, uint32 data size, uint32 request id, uint32 flags
+ * With the multiplexed header, each response carries the request id of
+ * its request, and the responses may be sent out of order: messages with
+ * more than FRAGMENT_SIZE bytes of data are sent in fragments, and the
+ * other messages are sent between the fragments, except the messages sent
+ * with sendMessageAfterFragments(). Each fragment has its
+ * own header, with the fragment size, and MESSAGE_FLAG_MORE_FRAGMENTS in
+ * all the fragments except the last. The requests are not fragmented,
+ * and their flags must be zero.
  *
+ * The time between sendMessage() and the end of the write is recorded in
+ * statistics(), as PHASE_SEND of the request that was being processed.
+ *
+ * The data size in the header of a received message is checked against
+ * the limit of its type (setMaxDataSize()) and against the memory budget
+ * (setMemoryBudget()) before any storage is reserved for the message.
+ * The messages of a chunked type (setChunked()) that do not fit in the
+ * input buffer are not stored complete: they are extracted in chunks
+ * (see dataChunk()).
  */
 class ArrayAcqProtocol {
 protected:
 	enum {
 		HEADER_RAW_BUFFER_SIZE = 8,
-		PROTOCOL_VERSION = 1006
+		MULTIPLEXED_HEADER_RAW_BUFFER_SIZE = 16,
+		PROTOCOL_VERSION = 1006,
+		MULTIPLEXED_PROTOCOL_VERSION = 1007,
+		INPUT_BUFFER_SIZE = 65536,
+		MAX_WRITE_MESSAGES = 64, // per gather write
+		INITIAL_OUTPUT_QUEUE_CAPACITY = 16, // messages
+		FRAGMENT_SIZE = 256 * 1024, // bytes, multiplexed header only
+		CHUNK_ALIGNMENT = 4 // bytes, the chunks (except the last) are multiples of this
+	};
+	enum MessageFlag {
+		MESSAGE_FLAG_MORE_FRAGMENTS = 1
 	};
 	enum MessageType {
 		CONNECT_REQUEST = 2001,
@@ -88,23 +133,255 @@ protected:
 		EXEC_PRE_CONFIGURATION_REQUEST,
 		EXEC_POST_CONFIGURATION_REQUEST,
 		EXEC_PRE_LOOP_CONFIGURATION_REQUEST,
-		EXEC_POST_LOOP_CONFIGURATION_REQUEST
+		EXEC_POST_LOOP_CONFIGURATION_REQUEST,
+
+		CONNECT_RESPONSE,
+		GET_SIGNAL_SHARED_MEMORY_RESPONSE,
+
+		START_STREAM_REQUEST,
+		STOP_STREAM_REQUEST,
+		STREAM_SIGNAL_RESPONSE,
+
+		GET_SIGNAL_BATCH_REQUEST,
+		GET_SIGNAL_BATCH_RESPONSE,
+
+		SET_CONFIGURATION_REQUEST,
+
+		GET_SIGNAL_COMPRESSED_RESPONSE,
+		GET_SIGNAL_PACKED_RESPONSE,
+
+		GET_SIGNAL_REGION_REQUEST,
+		GET_SIGNAL_REGION_RESPONSE,
+
+		SET_DECIMATION_REQUEST,
+		GET_SIGNAL_DECIMATED_RESPONSE,
+
+		GET_SERVER_STATS_REQUEST,
+		GET_SERVER_STATS_RESPONSE
+	};
+	// Optional bit mask sent after the protocol version in CONNECT_REQUEST.
+	// If present, the server answers with CONNECT_RESPONSE, containing
+	// the accepted options.
+	enum ConnectOption {
+		CONNECT_OPTION_SHARED_MEMORY = 1, // see SharedMemoryRing
+		CONNECT_OPTION_COMPRESSION   = 2, // see SignalCompressor
+		CONNECT_OPTION_LITTLE_ENDIAN = 4, // byte order of the message data
+		CONNECT_OPTION_PACKED_12BIT  = 8  // see SamplePacking
+	};
+
+	typedef MessageStatistics::Clock Clock;
+
+	// Part of the data of a received message.
+	struct DataChunk {
+		std::size_t offset; // in the message data
+		std::size_t messageDataSize;
+		bool last;
 	};
 
-	ArrayAcqProtocol() {}
-	~ArrayAcqProtocol() {}
+	ArrayAcqProtocol();
+	virtual ~ArrayAcqProtocol() {}
 
 	void prepareMessage(MessageType type);
-	void sendMessage(boost::asio::ip::tcp::socket& socket);
-	boost::uint32_t receiveMessage(boost::asio::ip::tcp::socket& socket);
+	void sendMessage();
+	// With the multiplexed header, the message is sent after the last
+	// fragment of the messages already queued.
+	void sendMessageAfterFragments();
+	bool receiveMessage(boost::uint32_t& messageType);
+	// Affects the messages received and sent after the call.
+	void setMultiplexed(bool multiplexed) { multiplexed_ = multiplexed; }
+	bool multiplexed() const { return multiplexed_; }
+	// The received messages with more data are rejected with InvalidRequestException.
+	// The first function sets the limit of all the types, including the unknown ones.
+	void setMaxDataSize(boost::uint32_t maxDataSize);
+	void setMaxDataSize(MessageType type, boost::uint32_t maxDataSize);
+	// The messages of this type that do not fit in the input buffer are
+	// received in chunks of at most INPUT_BUFFER_SIZE bytes.
+	void setChunked(MessageType type);
+	// The part of the message data that is in dataRawBuffer_, after receiveMessage().
+	// Only the messages of the chunked types may have more than one chunk.
+	const DataChunk& dataChunk() const { return dataChunk_; }
+	// Returns true if size more bytes of buffers fit in the memory budget,
+	// considering bufferCapacity(). If needed, the storage of the idle
+	// buffers is freed first.
+	bool fitsMemoryBudget(std::size_t size);
 
 	RawBuffer headerRawBuffer_;
 	RawBuffer dataRawBuffer_;
+	// Request id of the last received message. Used in the header of
+	// the sent messages, with the multiplexed header.
+	boost::uint32_t requestId_;
+	// Type of the last received message. The sent messages are accounted to it.
+	boost::uint32_t requestType_;
+	// When the last byte of the last received message was received.
+	Clock::time_point receiveTime_;
+	MessageStatistics statistics_;
+public:
+	static boost::uint32_t firstMessageType() { return CONNECT_REQUEST; }
+	static unsigned int numMessageTypes() { return GET_SERVER_STATS_RESPONSE - CONNECT_REQUEST + 1; }
+	static const char* messageTypeName(boost::uint32_t type);
+
+	boost::asio::mutable_buffer inputBuffer();
+	void inputReceived(std::size_t size);
+	// The storage used by inputBuffer(), except for the large messages.
+	// It does not change during the life of the object.
+	boost::asio::mutable_buffer inputStorage() { return boost::asio::buffer(inputBuffer_); }
+
+	bool outputPending() const;
+	std::size_t outputQueueSize() const { return outputQueueSize_; }
+	void getOutputBuffers(std::vector<boost::asio::const_buffer>& buffers);
+	void outputSent();
+
+	const MessageStatistics& statistics() const { return statistics_; }
+	void resetStatistics() { statistics_.reset(); }
+	boost::uint64_t bytesReceived() const { return bytesReceived_; }
+	boost::uint64_t bytesSent() const { return bytesSent_; }
+	// Bytes allocated by the buffers. The derived classes add the
+	// storage that they keep per session.
+	virtual std::size_t bufferCapacity() const;
+	// The buffers of the messages take their storage from pool (see RawBuffer).
+	void setRawBufferPool(RawBufferPool* pool);
+	// Limit of bufferCapacity() for the large received messages, and for the
+	// storage checked with fitsMemoryBudget(). 0: unlimited.
+	// The sent messages with more than INPUT_BUFFER_SIZE bytes are not
+	// kept for reuse when bufferCapacity() exceeds the budget.
+	void setMemoryBudget(std::size_t memoryBudget) { memoryBudget_ = memoryBudget; }
+	std::size_t memoryBudget() const { return memoryBudget_; }
 private:
+	struct OutputMessage {
+		RawBuffer header;
+		RawBuffer data;
+		std::size_t sentDataSize; // fragmented messages
+		bool fragmented; // in fragmentedOutputQueue_
+		boost::uint32_t requestType;
+		Clock::time_point queueTime;
+	};
+
+	// Grows only when full, so that the queue does not allocate in steady state.
+	typedef boost::circular_buffer<std::unique_ptr<OutputMessage>> OutputQueue;
+
+	void queueOutputMessage(bool afterFragments);
+	static void queueMessage(OutputQueue& queue, std::unique_ptr<OutputMessage> message);
+	void releaseMessage(std::unique_ptr<OutputMessage> message, Clock::time_point sentTime);
+	void freeIdleStorage();
+	boost::uint32_t maxDataSize(boost::uint32_t type) const;
+	bool receiveChunk(boost::uint32_t& messageType);
+
 	ArrayAcqProtocol(const ArrayAcqProtocol&);
 	ArrayAcqProtocol& operator=(const ArrayAcqProtocol&);
+
+	bool multiplexed_;
+	std::vector<boost::uint8_t> inputBuffer_; // received bytes, not yet processed
+	std::size_t inputBegin_;
+	std::size_t inputEnd_;
+	Clock::time_point inputTime_; // of the last inputReceived()
+	// A message larger than the input buffer is received directly in largeMessageRawBuffer_.
+	bool receivingLargeMessage_;
+	boost::uint32_t largeMessageType_;
+	boost::uint32_t largeMessageRequestId_;
+	std::size_t largeMessageReceivedSize_;
+	RawBuffer largeMessageRawBuffer_;
+	// A message of a chunked type larger than the input buffer is extracted in chunks.
+	bool receivingChunkedMessage_;
+	std::size_t chunkedMessageRemainingSize_;
+	DataChunk dataChunk_;
+	std::vector<boost::uint32_t> maxDataSize_; // indexed by type - firstMessageType()
+	boost::uint32_t defaultMaxDataSize_; // of the unknown types
+	std::vector<bool> chunked_; // indexed by type - firstMessageType()
+	std::size_t memoryBudget_;
+
+	OutputQueue outputQueue_;
+	OutputQueue fragmentedOutputQueue_;
+	std::vector<std::unique_ptr<OutputMessage>> freeOutputMessages_;
+	std::size_t numWritingMessages_; // the first messages in outputQueue_
+	bool writingFragment_; // of the first message in fragmentedOutputQueue_
+	std::size_t writingFragmentSize_; // may be zero for a message without data
+	RawBuffer fragmentHeaderRawBuffer_;
+	std::size_t outputQueueSize_; // bytes
+	boost::uint64_t bytesReceived_;
+	boost::uint64_t bytesSent_;
 };
 
+/*******************************************************************************
+ * Constructor.
+ */
+inline
+ArrayAcqProtocol::ArrayAcqProtocol()
+		: requestId_()
+		, requestType_()
+		, statistics_(firstMessageType(), numMessageTypes())
+		, multiplexed_()
+		, inputBuffer_(INPUT_BUFFER_SIZE)
+		, inputBegin_()
+		, inputEnd_()
+		, receivingLargeMessage_()
+		, largeMessageType_()
+		, largeMessageRequestId_()
+		, largeMessageReceivedSize_()
+		, receivingChunkedMessage_()
+		, chunkedMessageRemainingSize_()
+		, dataChunk_()
+		, maxDataSize_(numMessageTypes(), std::numeric_limits<boost::uint32_t>::max())
+		, defaultMaxDataSize_(std::numeric_limits<boost::uint32_t>::max())
+		, chunked_(numMessageTypes())
+		, memoryBudget_()
+		, outputQueue_(INITIAL_OUTPUT_QUEUE_CAPACITY)
+		, fragmentedOutputQueue_(INITIAL_OUTPUT_QUEUE_CAPACITY)
+		, numWritingMessages_()
+		, writingFragment_()
+		, writingFragmentSize_()
+		, outputQueueSize_()
+		, bytesReceived_()
+		, bytesSent_()
+{
+}
+
+/*******************************************************************************
+ * Only the buffers that grow to the message size use the pool.
+ * The other buffers receive their storage by swap().
+ */
+inline
+void
+ArrayAcqProtocol::setRawBufferPool(RawBufferPool* pool)
+{
+	dataRawBuffer_.setPool(pool);
+	largeMessageRawBuffer_.setPool(pool);
+}
+
+/*******************************************************************************
+ *
+ */
+inline
+void
+ArrayAcqProtocol::setMaxDataSize(boost::uint32_t maxDataSize)
+{
+	std::fill(maxDataSize_.begin(), maxDataSize_.end(), maxDataSize);
+	defaultMaxDataSize_ = maxDataSize;
+}
+
+inline
+void
+ArrayAcqProtocol::setMaxDataSize(MessageType type, boost::uint32_t maxDataSize)
+{
+	maxDataSize_[type - firstMessageType()] = maxDataSize;
+}
+
+inline
+boost::uint32_t
+ArrayAcqProtocol::maxDataSize(boost::uint32_t type) const
+{
+	if (type < firstMessageType() || type - firstMessageType() >= maxDataSize_.size()) {
+		return defaultMaxDataSize_;
+	}
+	return maxDataSize_[type - firstMessageType()];
+}
+
+inline
+void
+ArrayAcqProtocol::setChunked(MessageType type)
+{
+	chunked_[type - firstMessageType()] = true;
+}
+
 /*******************************************************************************
  *
  */
@@ -118,54 +395,419 @@ ArrayAcqProtocol::prepareMessage(MessageType type)
 	dataRawBuffer_.reset();
 }
 
+inline
+void
+ArrayAcqProtocol::sendMessage()
+{
+	queueOutputMessage(false);
+}
+
+inline
+void
+ArrayAcqProtocol::sendMessageAfterFragments()
+{
+	queueOutputMessage(true);
+}
+
 /*******************************************************************************
+ * Moves the message to the output queue.
  *
+ * The buffers are swapped, not copied. headerRawBuffer_ and
+ * dataRawBuffer_ receive the storage of an already sent message.
+ *
+ * A small message queued after the fragmented messages is sent as a
+ * single fragment, which is identical to the complete message.
  */
 inline
 void
-ArrayAcqProtocol::sendMessage(boost::asio::ip::tcp::socket& socket)
+ArrayAcqProtocol::queueOutputMessage(bool afterFragments)
 {
 	headerRawBuffer_.putUInt32(dataRawBuffer_.size());
+	if (multiplexed_) {
+		headerRawBuffer_.putUInt32(requestId_);
+		headerRawBuffer_.putUInt32(0); // flags
+	}
+
+	std::unique_ptr<OutputMessage> message;
+	if (freeOutputMessages_.empty()) {
+		message = std::make_unique<OutputMessage>();
+	} else {
+		message = std::move(freeOutputMessages_.back());
+		freeOutputMessages_.pop_back();
+	}
+	message->header.swap(headerRawBuffer_);
+	message->data.swap(dataRawBuffer_);
+	message->sentDataSize = 0;
+	message->fragmented = multiplexed_ && (message->data.size() > FRAGMENT_SIZE ||
+					(afterFragments && !fragmentedOutputQueue_.empty()));
+	message->requestType = requestType_;
+	message->queueTime = Clock::now();
+	outputQueueSize_ += message->header.size() + message->data.size();
+	if (message->fragmented) {
+		queueMessage(fragmentedOutputQueue_, std::move(message));
+	} else {
+		queueMessage(outputQueue_, std::move(message));
+	}
+}
+
+/*******************************************************************************
+ *
+ */
+inline
+void
+ArrayAcqProtocol::queueMessage(OutputQueue& queue, std::unique_ptr<OutputMessage> message)
+{
+	if (queue.full()) queue.set_capacity(2 * queue.capacity());
+	queue.push_back(std::move(message));
+}
+
+/*******************************************************************************
+ * Returns true if there are queued messages that are not being written.
+ */
+inline
+bool
+ArrayAcqProtocol::outputPending() const
+{
+	if (outputQueue_.size() > numWritingMessages_) return true;
+	if (fragmentedOutputQueue_.empty()) return false;
+	const OutputMessage& message = *fragmentedOutputQueue_.front();
+	return fragmentedOutputQueue_.size() > 1 || !writingFragment_ ||
+		message.sentDataSize + writingFragmentSize_ < message.data.size();
+}
+
+/*******************************************************************************
+ * Gets the queued messages that are not being written.
+ *
+ * The messages are marked as being written, until outputSent() is called.
+ * At most one fragment is written, after the other messages.
+ */
+inline
+void
+ArrayAcqProtocol::getOutputBuffers(std::vector<boost::asio::const_buffer>& buffers)
+{
+	buffers.clear();
+	while (numWritingMessages_ < outputQueue_.size() && numWritingMessages_ < MAX_WRITE_MESSAGES) {
+		const OutputMessage& message = *outputQueue_[numWritingMessages_++];
+		buffers.push_back(boost::asio::buffer(message.header.data(), message.header.size()));
+		if (message.data.size() > 0) {
+			buffers.push_back(boost::asio::buffer(message.data.data(), message.data.size()));
+		}
+	}
 
-	std::size_t n = boost::asio::write(socket, boost::asio::buffer(&(headerRawBuffer_.front()), headerRawBuffer_.size()));
-	if (n != headerRawBuffer_.size()) {
-		THROW_EXCEPTION(IOException, "[ArrayAcqProtocol::sendMessage] Wrong number of header bytes sent: " << n << " (expected: " << headerRawBuffer_.size() << ").");
+	if (!writingFragment_ && !fragmentedOutputQueue_.empty()) {
+		const OutputMessage& message = *fragmentedOutputQueue_.front();
+		const std::size_t remainingSize = message.data.size() - message.sentDataSize;
+		writingFragment_ = true;
+		writingFragmentSize_ = std::min<std::size_t>(remainingSize, FRAGMENT_SIZE);
+		fragmentHeaderRawBuffer_.reset();
+		fragmentHeaderRawBuffer_.putUInt32(RawBuffer::loadUInt32(message.header.data())); // type
+		fragmentHeaderRawBuffer_.putUInt32(writingFragmentSize_);
+		fragmentHeaderRawBuffer_.putUInt32(RawBuffer::loadUInt32(message.header.data() + 8)); // request id
+		fragmentHeaderRawBuffer_.putUInt32(remainingSize > writingFragmentSize_ ? MESSAGE_FLAG_MORE_FRAGMENTS : 0);
+		buffers.push_back(boost::asio::buffer(fragmentHeaderRawBuffer_.data(), fragmentHeaderRawBuffer_.size()));
+		buffers.push_back(boost::asio::buffer(message.data.data() + message.sentDataSize, writingFragmentSize_));
 	}
-	if (dataRawBuffer_.size() > 0) {
-		n = boost::asio::write(socket, boost::asio::buffer(&dataRawBuffer_.front(), dataRawBuffer_.size()));
-		if (n != dataRawBuffer_.size()) {
-			THROW_EXCEPTION(IOException, "[ArrayAcqProtocol::sendMessage] Wrong number of data bytes sent: " << n << " (expected: " << dataRawBuffer_.size() << ").");
+}
+
+/*******************************************************************************
+ * Releases the messages returned by the last getOutputBuffers().
+ */
+inline
+void
+ArrayAcqProtocol::outputSent()
+{
+	const Clock::time_point sentTime = Clock::now();
+	for ( ; numWritingMessages_ > 0; --numWritingMessages_) {
+		std::unique_ptr<OutputMessage> message = std::move(outputQueue_.front());
+		outputQueue_.pop_front();
+		releaseMessage(std::move(message), sentTime);
+	}
+
+	if (writingFragment_) {
+		OutputMessage& message = *fragmentedOutputQueue_.front();
+		bytesSent_ += fragmentHeaderRawBuffer_.size() + writingFragmentSize_;
+		message.sentDataSize += writingFragmentSize_;
+		writingFragment_ = false;
+		writingFragmentSize_ = 0;
+		if (message.sentDataSize == message.data.size()) {
+			std::unique_ptr<OutputMessage> sentMessage = std::move(fragmentedOutputQueue_.front());
+			fragmentedOutputQueue_.pop_front();
+			releaseMessage(std::move(sentMessage), sentTime);
 		}
 	}
 }
 
+inline
+void
+ArrayAcqProtocol::releaseMessage(std::unique_ptr<OutputMessage> message, Clock::time_point sentTime)
+{
+	statistics_.record(message->requestType, MessageStatistics::PHASE_SEND, sentTime - message->queueTime);
+	outputQueueSize_ -= message->header.size() + message->data.size();
+	if (!message->fragmented) {
+		bytesSent_ += message->header.size() + message->data.size();
+	}
+	if (memoryBudget_ > 0 && message->data.capacity() > INPUT_BUFFER_SIZE &&
+			bufferCapacity() + message->data.capacity() > memoryBudget_) {
+		message->data.clear();
+	}
+	freeOutputMessages_.push_back(std::move(message));
+}
+
 /*******************************************************************************
+ * Frees the storage of the buffers that are not in use.
+ */
+inline
+void
+ArrayAcqProtocol::freeIdleStorage()
+{
+	for (auto& message : freeOutputMessages_) {
+		message->header.clear();
+		message->data.clear();
+	}
+	if (!receivingLargeMessage_) largeMessageRawBuffer_.clear();
+}
+
+inline
+bool
+ArrayAcqProtocol::fitsMemoryBudget(std::size_t size)
+{
+	if (memoryBudget_ == 0) return true;
+	if (size <= memoryBudget_ && bufferCapacity() <= memoryBudget_ - size) return true;
+	freeIdleStorage();
+	return size <= memoryBudget_ && bufferCapacity() <= memoryBudget_ - size;
+}
+
+inline
+std::size_t
+ArrayAcqProtocol::bufferCapacity() const
+{
+	std::size_t capacity = headerRawBuffer_.capacity() + dataRawBuffer_.capacity() +
+				inputBuffer_.capacity() + largeMessageRawBuffer_.capacity() +
+				fragmentHeaderRawBuffer_.capacity();
+	for (const auto* queue : { &outputQueue_, &fragmentedOutputQueue_ }) {
+		for (const auto& message : *queue) {
+			capacity += message->header.capacity() + message->data.capacity();
+		}
+	}
+	for (const auto& message : freeOutputMessages_) {
+		capacity += message->header.capacity() + message->data.capacity();
+	}
+	return capacity;
+}
+
+/*******************************************************************************
+ * Returns the free space where the next received bytes must be written.
+ */
+inline
+boost::asio::mutable_buffer
+ArrayAcqProtocol::inputBuffer()
+{
+	if (receivingLargeMessage_) {
+		return boost::asio::buffer(&largeMessageRawBuffer_.front() + largeMessageReceivedSize_,
+						largeMessageRawBuffer_.size() - largeMessageReceivedSize_);
+	}
+
+	if (inputBegin_ > 0) {
+		std::memmove(&inputBuffer_[0], &inputBuffer_[inputBegin_], inputEnd_ - inputBegin_);
+		inputEnd_ -= inputBegin_;
+		inputBegin_ = 0;
+	}
+	return boost::asio::buffer(&inputBuffer_[inputEnd_], inputBuffer_.size() - inputEnd_);
+}
+
+/*******************************************************************************
+ * size bytes have been written to inputBuffer().
+ */
+inline
+void
+ArrayAcqProtocol::inputReceived(std::size_t size)
+{
+	if (receivingLargeMessage_) {
+		largeMessageReceivedSize_ += size;
+	} else {
+		inputEnd_ += size;
+	}
+	bytesReceived_ += size;
+	inputTime_ = Clock::now();
+}
+
+/*******************************************************************************
+ * Extracts the next complete message, or the next chunk of a message of
+ * a chunked type.
  *
+ * Returns false if more bytes must be received. The data of the message
+ * are placed in dataRawBuffer_.
  */
 inline
-boost::uint32_t
-ArrayAcqProtocol::receiveMessage(boost::asio::ip::tcp::socket& socket)
+bool
+ArrayAcqProtocol::receiveMessage(boost::uint32_t& messageType)
 {
-	headerRawBuffer_.reserve(HEADER_RAW_BUFFER_SIZE);
-	std::size_t n = boost::asio::read(socket, boost::asio::buffer(&headerRawBuffer_.front(), headerRawBuffer_.size()));
-	if (n != headerRawBuffer_.size()) {
-		THROW_EXCEPTION(IOException, "[ArrayAcqProtocol::receiveMessage] Wrong number of header bytes received: " << n << " (expected: " << headerRawBuffer_.size() << ").");
+	if (receivingLargeMessage_) {
+		if (largeMessageReceivedSize_ < largeMessageRawBuffer_.size()) return false;
+		receivingLargeMessage_ = false;
+		dataRawBuffer_.swap(largeMessageRawBuffer_);
+		dataChunk_.offset = 0;
+		dataChunk_.messageDataSize = dataRawBuffer_.size();
+		dataChunk_.last = true;
+		messageType = largeMessageType_;
+		requestId_ = largeMessageRequestId_;
+		requestType_ = messageType;
+		receiveTime_ = inputTime_;
+		return true;
 	}
+	if (receivingChunkedMessage_) return receiveChunk(messageType);
+
+	const std::size_t headerSize = multiplexed_ ? MULTIPLEXED_HEADER_RAW_BUFFER_SIZE : HEADER_RAW_BUFFER_SIZE;
+	const std::size_t bufferedSize = inputEnd_ - inputBegin_;
+	if (bufferedSize < headerSize) return false;
+
+	const boost::uint8_t* header = &inputBuffer_[inputBegin_];
+	const boost::uint32_t type = RawBuffer::loadUInt32(header);
+	const boost::uint32_t dataSize = RawBuffer::loadUInt32(header + 4);
+	if (dataSize > maxDataSize(type)) {
+		THROW_EXCEPTION(InvalidRequestException, "Message too large: type=" << type << " data size=" << dataSize <<
+					" limit=" << maxDataSize(type) << '.');
+	}
+	boost::uint32_t requestId = 0;
+	if (multiplexed_) {
+		requestId = RawBuffer::loadUInt32(header + 8);
+		if (RawBuffer::loadUInt32(header + 12) != 0) {
+			THROW_EXCEPTION(InvalidRequestException, "Invalid message flags.");
+		}
+	}
+
+	if (dataSize > INPUT_BUFFER_SIZE - headerSize) {
+		const bool chunked = type >= firstMessageType() && type - firstMessageType() < chunked_.size() &&
+					chunked_[type - firstMessageType()];
+		if (!chunked && dataSize > largeMessageRawBuffer_.capacity()) {
+			// The storage is replaced, not grown, to allocate only the size of the message.
+			largeMessageRawBuffer_.clear();
+			if (!fitsMemoryBudget(dataSize)) {
+				THROW_EXCEPTION(InvalidRequestException, "The message (type=" << type << " data size=" << dataSize <<
+							") exceeds the memory budget of the session (" << memoryBudget_ << " bytes).");
+			}
+		}
 
-	boost::uint32_t messageType = headerRawBuffer_.getUInt32();
+		inputBegin_ += headerSize;
+		largeMessageType_ = type;
+		largeMessageRequestId_ = requestId;
+		if (chunked) {
+			receivingChunkedMessage_ = true;
+			chunkedMessageRemainingSize_ = dataSize;
+			dataChunk_.messageDataSize = dataSize;
+			return receiveChunk(messageType);
+		}
+
+		// Large message. Copy the buffered part, then receive the rest directly.
+		largeMessageRawBuffer_.reserve(dataSize);
+		largeMessageReceivedSize_ = std::min<std::size_t>(inputEnd_ - inputBegin_, dataSize);
+		std::memcpy(&largeMessageRawBuffer_.front(), &inputBuffer_[inputBegin_], largeMessageReceivedSize_);
+		inputBegin_ += largeMessageReceivedSize_;
+		receivingLargeMessage_ = true;
+		return receiveMessage(messageType);
+	}
 
-	//TODO: check type???
-	const boost::uint32_t dataSize = headerRawBuffer_.getUInt32();
+	if (bufferedSize - headerSize < dataSize) return false;
 
+	inputBegin_ += headerSize;
 	if (dataSize > 0) {
 		dataRawBuffer_.reserve(dataSize);
-		n = boost::asio::read(socket, boost::asio::buffer(&dataRawBuffer_.front(), dataRawBuffer_.size()));
-		if (n != dataRawBuffer_.size()) {
-			THROW_EXCEPTION(IOException, "[ArrayAcqProtocol::receiveMessage] Wrong number of data bytes received: " << n << " (expected: " << dataRawBuffer_.size() << ").");
-		}
+		std::memcpy(&dataRawBuffer_.front(), &inputBuffer_[inputBegin_], dataSize);
+		inputBegin_ += dataSize;
+	} else {
+		dataRawBuffer_.reset();
 	}
+	dataChunk_.offset = 0;
+	dataChunk_.messageDataSize = dataSize;
+	dataChunk_.last = true;
+	messageType = type;
+	requestId_ = requestId;
+	requestType_ = messageType;
+	receiveTime_ = inputTime_;
+	return true;
+}
 
-	return messageType;
+/*******************************************************************************
+ * Extracts the buffered part of the chunked message that is being received.
+ *
+ * The chunks (except the last) are multiples of CHUNK_ALIGNMENT bytes,
+ * so that the array elements are not split.
+ */
+inline
+bool
+ArrayAcqProtocol::receiveChunk(boost::uint32_t& messageType)
+{
+	std::size_t size = std::min<std::size_t>(inputEnd_ - inputBegin_, chunkedMessageRemainingSize_);
+	if (size < chunkedMessageRemainingSize_) size -= size % CHUNK_ALIGNMENT;
+	if (size == 0) return false;
+
+	dataRawBuffer_.reserve(size);
+	std::memcpy(&dataRawBuffer_.front(), &inputBuffer_[inputBegin_], size);
+	inputBegin_ += size;
+	dataChunk_.offset = dataChunk_.messageDataSize - chunkedMessageRemainingSize_;
+	chunkedMessageRemainingSize_ -= size;
+	dataChunk_.last = (chunkedMessageRemainingSize_ == 0);
+	receivingChunkedMessage_ = !dataChunk_.last;
+	messageType = largeMessageType_;
+	requestId_ = largeMessageRequestId_;
+	requestType_ = messageType;
+	receiveTime_ = inputTime_;
+	return true;
+}
+
+/*******************************************************************************
+ *
+ */
+inline
+const char*
+ArrayAcqProtocol::messageTypeName(boost::uint32_t type)
+{
+	switch (type) {
+	case CONNECT_REQUEST:                      return "CONNECT_REQUEST";
+	case DISCONNECT_REQUEST:                   return "DISCONNECT_REQUEST";
+	case OK_RESPONSE:                          return "OK_RESPONSE";
+	case ERROR_RESPONSE:                       return "ERROR_RESPONSE";
+	case GET_SIGNAL_LENGTH_REQUEST:            return "GET_SIGNAL_LENGTH_REQUEST";
+	case GET_SIGNAL_LENGTH_RESPONSE:           return "GET_SIGNAL_LENGTH_RESPONSE";
+	case GET_SIGNAL_REQUEST:                   return "GET_SIGNAL_REQUEST";
+	case GET_SIGNAL_RESPONSE:                  return "GET_SIGNAL_RESPONSE";
+	case GET_MAX_SAMPLE_VALUE_REQUEST:         return "GET_MAX_SAMPLE_VALUE_REQUEST";
+	case GET_MAX_SAMPLE_VALUE_RESPONSE:        return "GET_MAX_SAMPLE_VALUE_RESPONSE";
+	case GET_MIN_SAMPLE_VALUE_REQUEST:         return "GET_MIN_SAMPLE_VALUE_REQUEST";
+	case GET_MIN_SAMPLE_VALUE_RESPONSE:        return "GET_MIN_SAMPLE_VALUE_RESPONSE";
+	case GET_SAMPLING_FREQUENCY_REQUEST:       return "GET_SAMPLING_FREQUENCY_REQUEST";
+	case GET_SAMPLING_FREQUENCY_RESPONSE:      return "GET_SAMPLING_FREQUENCY_RESPONSE";
+	case SET_ACQUISITION_TIME_REQUEST:         return "SET_ACQUISITION_TIME_REQUEST";
+	case SET_ACTIVE_RECEIVE_ELEMENTS_REQUEST:  return "SET_ACTIVE_RECEIVE_ELEMENTS_REQUEST";
+	case SET_ACTIVE_TRANSMIT_ELEMENTS_REQUEST: return "SET_ACTIVE_TRANSMIT_ELEMENTS_REQUEST";
+	case SET_BASE_ELEMENT_REQUEST:             return "SET_BASE_ELEMENT_REQUEST";
+	case SET_CENTER_FREQUENCY_REQUEST:         return "SET_CENTER_FREQUENCY_REQUEST";
+	case SET_GAIN_REQUEST:                     return "SET_GAIN_REQUEST";
+	case SET_RECEIVE_DELAYS_REQUEST:           return "SET_RECEIVE_DELAYS_REQUEST";
+	case SET_SAMPLING_FREQUENCY_REQUEST:       return "SET_SAMPLING_FREQUENCY_REQUEST";
+	case SET_TRANSMIT_DELAYS_REQUEST:          return "SET_TRANSMIT_DELAYS_REQUEST";
+	case EXEC_PRE_CONFIGURATION_REQUEST:       return "EXEC_PRE_CONFIGURATION_REQUEST";
+	case EXEC_POST_CONFIGURATION_REQUEST:      return "EXEC_POST_CONFIGURATION_REQUEST";
+	case EXEC_PRE_LOOP_CONFIGURATION_REQUEST:  return "EXEC_PRE_LOOP_CONFIGURATION_REQUEST";
+	case EXEC_POST_LOOP_CONFIGURATION_REQUEST: return "EXEC_POST_LOOP_CONFIGURATION_REQUEST";
+	case CONNECT_RESPONSE:                     return "CONNECT_RESPONSE";
+	case GET_SIGNAL_SHARED_MEMORY_RESPONSE:    return "GET_SIGNAL_SHARED_MEMORY_RESPONSE";
+	case START_STREAM_REQUEST:                 return "START_STREAM_REQUEST";
+	case STOP_STREAM_REQUEST:                  return "STOP_STREAM_REQUEST";
+	case STREAM_SIGNAL_RESPONSE:               return "STREAM_SIGNAL_RESPONSE";
+	case GET_SIGNAL_BATCH_REQUEST:             return "GET_SIGNAL_BATCH_REQUEST";
+	case GET_SIGNAL_BATCH_RESPONSE:            return "GET_SIGNAL_BATCH_RESPONSE";
+	case SET_CONFIGURATION_REQUEST:            return "SET_CONFIGURATION_REQUEST";
+	case GET_SIGNAL_COMPRESSED_RESPONSE:       return "GET_SIGNAL_COMPRESSED_RESPONSE";
+	case GET_SIGNAL_PACKED_RESPONSE:           return "GET_SIGNAL_PACKED_RESPONSE";
+	case GET_SIGNAL_REGION_REQUEST:            return "GET_SIGNAL_REGION_REQUEST";
+	case GET_SIGNAL_REGION_RESPONSE:           return "GET_SIGNAL_REGION_RESPONSE";
+	case SET_DECIMATION_REQUEST:               return "SET_DECIMATION_REQUEST";
+	case GET_SIGNAL_DECIMATED_RESPONSE:        return "GET_SIGNAL_DECIMATED_RESPONSE";
+	case GET_SERVER_STATS_REQUEST:             return "GET_SERVER_STATS_REQUEST";
+	case GET_SERVER_STATS_RESPONSE:            return "GET_SERVER_STATS_RESPONSE";
+	default:                                   return "UNKNOWN";
+	}
 }
 
 } // namespace Lab
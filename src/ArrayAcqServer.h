@@ -32,14 +32,34 @@
 #ifndef ARRAYACQSERVER_H_
 #define ARRAYACQSERVER_H_
 
-#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <cstdio> /* rename, remove */
+#include <exception>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <vector>
 
+#include <boost/asio/buffer.hpp>
+#include <boost/asio/io_context.hpp>
 #include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/local/stream_protocol.hpp>
 #include <boost/asio/placeholders.hpp>
+#include <boost/asio/post.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/asio/write.hpp>
 #include <boost/bind.hpp>
 
-#include "ArrayAcqServerProtocol.h"
+#include "ArrayAcqServerSession.h"
 #include "Exception.h"
+#include "IoUring.h"
+#include "Log.h"
+#include "RawBufferPool.h"
+#include "ServerConfiguration.h"
+#include "ServerStatistics.h"
 
 
 
@@ -48,42 +68,111 @@ namespace Lab {
 struct BindException : public virtual Exception {};
 
 /*******************************************************************************
+ * Accepts any number of clients, each one served by an ArrayAcqServerSession.
  *
+ * The sessions run in a pool of config.numThreads threads. The sessions are
+ * asynchronous, so one thread can serve any number of clients.
+ *
+ * If the io_uring backend is selected but not available, the sessions use asio.
+ *
+ * The listening socket is kept open while the server is disabled. The
+ * connections accepted in this state are closed immediately, and
+ * enable() takes effect at the next connection.
+ *
+ * If config.statisticsLogPeriod > 0, the latency percentiles of each message
+ * type (see MessageStatistics), since the start of the server, are logged
+ * periodically.
+ *
+ * The server statistics (see ServerStatistics) may be exported to
+ * config.metricsFile, rewritten every METRICS_FILE_PERIOD_MS (the file is
+ * replaced atomically), and to the Unix domain socket config.metricsSocket,
+ * which sends them to each client and closes the connection.
+ *
+ * The message buffers of the sessions take their storage from a pool of
+ * blocks of the device frame size, reused across the sessions.
  */
 template<typename AcqDevice>
 class ArrayAcqServer {
 public:
-	ArrayAcqServer(unsigned short portNumber, AcqDevice& acqDevice);
+	ArrayAcqServer(unsigned short portNumber, const AcqDevice& acqDevice, const ServerConfiguration& config);
 	~ArrayAcqServer();
 
 	void exec();
 	void stop();
+	void enable();
+	void disable();
 private:
+	typedef ArrayAcqServerSession<AcqDevice> Session;
+	typedef boost::asio::local::stream_protocol::socket LocalSocket;
+
+	enum {
+		ACCEPT_RETRY_DELAY_MS = 100, // after running out of file descriptors
+		METRICS_FILE_PERIOD_MS = 5000,
+		RAW_BUFFER_POOL_BLOCK_MARGIN = 64, // bytes, for the fields before the samples
+		RAW_BUFFER_POOL_MAX_FREE_BLOCKS = 8
+	};
+
 	ArrayAcqServer(const ArrayAcqServer&);
 	ArrayAcqServer& operator=(const ArrayAcqServer&);
 
-	void handleAccept(const boost::system::error_code& error);
+	bool stopped();
+	void shutdown();
+	void startAccept();
+	void handleAccept(std::shared_ptr<Session> session, const boost::system::error_code& error);
+	void handleAcceptRetryTimer(const boost::system::error_code& ec);
+	void runIoContext();
+	void startStatisticsTimer();
+	void handleStatisticsTimer(const boost::system::error_code& ec);
+	void startMetricsFileTimer();
+	void handleMetricsFileTimer(const boost::system::error_code& ec);
+	void startMetricsAccept();
+	void handleMetricsAccept(std::shared_ptr<LocalSocket> socket, const boost::system::error_code& ec);
 
+	// Destroyed after ioContext_, which may own sessions.
+	RawBufferPool rawBufferPool_;
 	boost::asio::io_context ioContext_;
 	boost::asio::ip::tcp::acceptor acceptor_;
-	boost::asio::ip::tcp::socket socket_;
-	AcqDevice& acqDevice_;
-	ArrayAcqServerProtocol<AcqDevice> protocol_;
+	boost::asio::steady_timer acceptRetryTimer_;
+	const AcqDevice& acqDevice_;
+	ServerConfiguration config_;
+	ServerStatistics statistics_;
+	boost::asio::steady_timer statisticsTimer_;
+	boost::asio::steady_timer metricsFileTimer_;
+	boost::asio::local::stream_protocol::acceptor metricsAcceptor_;
+	std::mutex mutex_;
+	std::vector<std::weak_ptr<Session>> sessions_; // protected by mutex_
+	bool enabled_; // protected by mutex_
+	bool stopped_; // protected by mutex_
+	std::exception_ptr exception_; // protected by mutex_
 };
 
 /*******************************************************************************
  * Constructor.
  */
 template<typename AcqDevice>
-ArrayAcqServer<AcqDevice>::ArrayAcqServer(unsigned short portNumber, AcqDevice& acqDevice)
-		: ioContext_()
+ArrayAcqServer<AcqDevice>::ArrayAcqServer(unsigned short portNumber, const AcqDevice& acqDevice, const ServerConfiguration& config)
+		: rawBufferPool_(acqDevice.getSignalBufferSize() * sizeof(boost::int16_t) + RAW_BUFFER_POOL_BLOCK_MARGIN,
+					RAW_BUFFER_POOL_MAX_FREE_BLOCKS)
+		, ioContext_()
 		, acceptor_(ioContext_)
-		, socket_(ioContext_)
+		, acceptRetryTimer_(ioContext_)
 		, acqDevice_(acqDevice)
-		, protocol_(acqDevice_)
+		, config_(config)
+		, statisticsTimer_(ioContext_)
+		, metricsFileTimer_(ioContext_)
+		, metricsAcceptor_(ioContext_)
+		, enabled_(true)
+		, stopped_()
 {
+	if (config_.numThreads == 0) config_.numThreads = 1;
+	if (config_.ioBackend == ServerConfiguration::IO_BACKEND_IO_URING && !IoUring::isAvailable()) {
+		LOG_ERROR << "io_uring is not available, using asio.";
+		config_.ioBackend = ServerConfiguration::IO_BACKEND_ASIO;
+	}
+
 	boost::asio::ip::tcp::endpoint endPoint(boost::asio::ip::tcp::v4(), portNumber);
 	acceptor_.open(endPoint.protocol());
+	acceptor_.set_option(boost::asio::ip::tcp::acceptor::reuse_address(true));
 
 	boost::system::error_code ec;
 	acceptor_.bind(endPoint, ec);
@@ -93,6 +182,15 @@ ArrayAcqServer<AcqDevice>::ArrayAcqServer(unsigned short portNumber, AcqDevice&
 
 	boost::asio::ip::tcp::no_delay option(true);
 	acceptor_.set_option(option);
+
+	if (!config_.metricsSocket.empty()) {
+		std::remove(config_.metricsSocket.c_str()); // left by a previous server
+		const boost::asio::local::stream_protocol::endpoint metricsEndPoint(config_.metricsSocket);
+		metricsAcceptor_.open(metricsEndPoint.protocol());
+		metricsAcceptor_.bind(metricsEndPoint, ec);
+		if (ec) THROW_EXCEPTION(BindException, "Bind error (metrics socket): " << ec.message());
+		metricsAcceptor_.listen();
+	}
 }
 
 /*******************************************************************************
@@ -101,25 +199,61 @@ ArrayAcqServer<AcqDevice>::ArrayAcqServer(unsigned short portNumber, AcqDevice&
 template<typename AcqDevice>
 ArrayAcqServer<AcqDevice>::~ArrayAcqServer()
 {
+	if (metricsAcceptor_.is_open()) {
+		boost::system::error_code ec;
+		metricsAcceptor_.close(ec);
+		std::remove(config_.metricsSocket.c_str());
+	}
 }
 
 /*******************************************************************************
- *
+ * Returns after stop() has been called and the sessions have been closed,
+ * or after an error.
  */
 template<typename AcqDevice>
 void
 ArrayAcqServer<AcqDevice>::exec()
 {
-	std::cout << "Before accept" << std::endl;
+	LOG_DEBUG << "Server: accepting connections.";
 
-//	boost::system::error_code ec;
-//	acceptor_.accept(socket_, ec);
-//	handleAccept(ec);
+	startAccept();
+	if (config_.statisticsLogPeriod > 0) startStatisticsTimer();
+	if (!config_.metricsFile.empty()) startMetricsFileTimer();
+	if (metricsAcceptor_.is_open()) startMetricsAccept();
 
-	acceptor_.async_accept(
-			socket_,
-			boost::bind(&ArrayAcqServer<AcqDevice>::handleAccept, this, boost::asio::placeholders::error));
-	ioContext_.run();
+	std::vector<std::thread> threadList;
+	for (unsigned int i = 1; i < config_.numThreads; ++i) {
+		threadList.emplace_back(&ArrayAcqServer<AcqDevice>::runIoContext, this);
+	}
+	runIoContext();
+	for (auto& t : threadList) {
+		t.join();
+	}
+
+	std::lock_guard<std::mutex> locker(mutex_);
+	if (exception_) {
+		std::exception_ptr e = exception_;
+		exception_ = nullptr;
+		std::rethrow_exception(e);
+	}
+}
+
+/*******************************************************************************
+ *
+ */
+template<typename AcqDevice>
+void
+ArrayAcqServer<AcqDevice>::runIoContext()
+{
+	try {
+		ioContext_.run();
+	} catch (...) {
+		{
+			std::lock_guard<std::mutex> locker(mutex_);
+			if (!exception_) exception_ = std::current_exception();
+		}
+		stop();
+	}
 }
 
 /*******************************************************************************
@@ -127,25 +261,239 @@ ArrayAcqServer<AcqDevice>::exec()
  */
 template<typename AcqDevice>
 void
-ArrayAcqServer<AcqDevice>::handleAccept(const boost::system::error_code& ec)
+ArrayAcqServer<AcqDevice>::startAccept()
+{
+	auto session = std::make_shared<Session>(ioContext_, acqDevice_, config_, statistics_, rawBufferPool_);
+	acceptor_.async_accept(
+			session->socket(),
+			boost::bind(&ArrayAcqServer<AcqDevice>::handleAccept, this, session, boost::asio::placeholders::error));
+}
+
+/*******************************************************************************
+ * An error in accept does not affect the connected sessions. If the process
+ * or the system has run out of file descriptors, the next accept is delayed
+ * by ACCEPT_RETRY_DELAY_MS.
+ */
+template<typename AcqDevice>
+void
+ArrayAcqServer<AcqDevice>::handleAccept(std::shared_ptr<Session> session, const boost::system::error_code& ec)
 {
 	if (ec) {
-		THROW_EXCEPTION(NetworkException, "Error in accept: " << ec.message());
+		if (ec == boost::asio::error::operation_aborted) return;
+		{
+			std::lock_guard<std::mutex> locker(mutex_);
+			if (stopped_) return;
+		}
+		LOG_ERROR << "Error in accept: " << ec.message();
+		if (ec == boost::asio::error::no_descriptors ||
+				ec == boost::system::errc::too_many_files_open_in_system) {
+			acceptRetryTimer_.expires_after(std::chrono::milliseconds(ACCEPT_RETRY_DELAY_MS));
+			acceptRetryTimer_.async_wait(
+					boost::bind(&ArrayAcqServer<AcqDevice>::handleAcceptRetryTimer, this,
+							boost::asio::placeholders::error));
+		} else {
+			startAccept();
+		}
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> locker(mutex_);
+		if (stopped_) return;
+		if (!enabled_) {
+			boost::system::error_code closeEc;
+			session->socket().close(closeEc);
+			startAccept();
+			return;
+		}
+		sessions_.erase(
+			std::remove_if(sessions_.begin(), sessions_.end(),
+					[](const std::weak_ptr<Session>& s) { return s.expired(); }),
+			sessions_.end());
+		if (config_.maxSessions > 0 && sessions_.size() >= config_.maxSessions) {
+			LOG_ERROR << "Too many sessions (" << sessions_.size() << "), the connection was closed.";
+			boost::system::error_code closeEc;
+			session->socket().close(closeEc);
+			startAccept();
+			return;
+		}
+		sessions_.push_back(session);
+	}
+
+	session->start();
+
+	startAccept();
+}
+
+template<typename AcqDevice>
+void
+ArrayAcqServer<AcqDevice>::handleAcceptRetryTimer(const boost::system::error_code& ec)
+{
+	if (ec || stopped()) return;
+	startAccept();
+}
+
+template<typename AcqDevice>
+void
+ArrayAcqServer<AcqDevice>::startStatisticsTimer()
+{
+	statisticsTimer_.expires_after(std::chrono::seconds(config_.statisticsLogPeriod));
+	statisticsTimer_.async_wait(
+			boost::bind(&ArrayAcqServer<AcqDevice>::handleStatisticsTimer, this, boost::asio::placeholders::error));
+}
+
+template<typename AcqDevice>
+void
+ArrayAcqServer<AcqDevice>::handleStatisticsTimer(const boost::system::error_code& ec)
+{
+	if (ec || stopped()) return;
+
+	const MessageStatistics messageStatistics = statistics_.messageStatistics();
+	if (!messageStatistics.empty()) {
+		std::ostringstream out;
+		messageStatistics.print(out, &ArrayAcqProtocol::messageTypeName);
+		LOG_DEBUG << "Message latency:\n" << out.str();
+	}
+
+	startStatisticsTimer();
+}
+
+template<typename AcqDevice>
+void
+ArrayAcqServer<AcqDevice>::startMetricsFileTimer()
+{
+	metricsFileTimer_.expires_after(std::chrono::milliseconds(METRICS_FILE_PERIOD_MS));
+	metricsFileTimer_.async_wait(
+			boost::bind(&ArrayAcqServer<AcqDevice>::handleMetricsFileTimer, this, boost::asio::placeholders::error));
+}
+
+/*******************************************************************************
+ * The readers never see a partial file.
+ */
+template<typename AcqDevice>
+void
+ArrayAcqServer<AcqDevice>::handleMetricsFileTimer(const boost::system::error_code& ec)
+{
+	if (ec || stopped()) return;
+
+	const std::string tempFile = config_.metricsFile + ".tmp";
+	{
+		std::ofstream out(tempFile.c_str());
+		statistics_.writeMetrics(out);
+		out.close();
+		if (!out || std::rename(tempFile.c_str(), config_.metricsFile.c_str()) != 0) {
+			LOG_ERROR << "Could not write the metrics file: " << config_.metricsFile;
+		}
+	}
+
+	startMetricsFileTimer();
+}
+
+template<typename AcqDevice>
+void
+ArrayAcqServer<AcqDevice>::startMetricsAccept()
+{
+	auto socket = std::make_shared<LocalSocket>(ioContext_);
+	metricsAcceptor_.async_accept(
+			*socket,
+			boost::bind(&ArrayAcqServer<AcqDevice>::handleMetricsAccept, this, socket, boost::asio::placeholders::error));
+}
+
+template<typename AcqDevice>
+void
+ArrayAcqServer<AcqDevice>::handleMetricsAccept(std::shared_ptr<LocalSocket> socket, const boost::system::error_code& ec)
+{
+	if (ec == boost::asio::error::operation_aborted || stopped()) return;
+	if (!ec) {
+		std::ostringstream out;
+		statistics_.writeMetrics(out);
+		auto text = std::make_shared<std::string>(out.str());
+		// The socket and the text are kept alive by the handler.
+		boost::asio::async_write(*socket, boost::asio::buffer(*text),
+				[socket, text](const boost::system::error_code&, std::size_t) {
+					boost::system::error_code closeEc;
+					socket->close(closeEc);
+				});
 	} else {
-		std::cout << "Before protocol_.exec" << std::endl;
-		protocol_.exec(socket_);
-		std::cout << "After protocol_.exec" << std::endl;
+		LOG_ERROR << "Error in accept (metrics socket): " << ec.message();
 	}
+
+	startMetricsAccept();
 }
 
 /*******************************************************************************
+ * May be called from another thread.
+ */
+template<typename AcqDevice>
+void
+ArrayAcqServer<AcqDevice>::enable()
+{
+	std::lock_guard<std::mutex> locker(mutex_);
+	enabled_ = true;
+}
+
+/*******************************************************************************
+ * Closes the connections. The listening socket is kept open.
+ *
+ * May be called from another thread.
+ */
+template<typename AcqDevice>
+void
+ArrayAcqServer<AcqDevice>::disable()
+{
+	std::lock_guard<std::mutex> locker(mutex_);
+	enabled_ = false;
+	for (auto& s : sessions_) {
+		if (auto session = s.lock()) session->stop();
+	}
+	sessions_.clear();
+}
+
+/*******************************************************************************
+ * exec() returns when the io_context runs out of work, after the sessions
+ * have been closed.
  *
+ * May be called from another thread.
  */
 template<typename AcqDevice>
 void
 ArrayAcqServer<AcqDevice>::stop()
 {
-	ioContext_.stop();
+	{
+		std::lock_guard<std::mutex> locker(mutex_);
+		if (stopped_) return;
+		stopped_ = true;
+	}
+	boost::asio::post(ioContext_, boost::bind(&ArrayAcqServer<AcqDevice>::shutdown, this));
+}
+
+template<typename AcqDevice>
+bool
+ArrayAcqServer<AcqDevice>::stopped()
+{
+	std::lock_guard<std::mutex> locker(mutex_);
+	return stopped_;
+}
+
+/*******************************************************************************
+ * Cancels the operations of the server, and closes the sessions.
+ */
+template<typename AcqDevice>
+void
+ArrayAcqServer<AcqDevice>::shutdown()
+{
+	boost::system::error_code ec;
+	acceptor_.close(ec);
+	acceptRetryTimer_.cancel();
+	statisticsTimer_.cancel();
+	metricsFileTimer_.cancel();
+	metricsAcceptor_.cancel(ec);
+
+	std::lock_guard<std::mutex> locker(mutex_);
+	for (auto& s : sessions_) {
+		if (auto session = s.lock()) session->stop();
+	}
+	sessions_.clear();
 }
 
 } // namespace Lab
@@ -32,478 +32,1532 @@
 #ifndef ARRAYACQSERVERPROTOCOL_H_
 #define ARRAYACQSERVERPROTOCOL_H_
 
-#include <boost/asio/ip/tcp.hpp>
-
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "AllocationCounter.h"
 #include "ArrayAcqProtocol.h"
 #include "Log.h"
+#include "SamplePacking.h"
+#include "ServerStatistics.h"
+#include "SharedMemoryRing.h"
+#include "SignalCompressor.h"
+#include "SignalDecimator.h"
 
 
 
 namespace Lab {
 
+/*******************************************************************************
+ * Server side of the protocol, as an event-driven state machine.
+ *
+ * The transport is handled by ArrayAcqServerSession, which feeds the
+ * received bytes, calls processMessages() and sends the output queue.
+ *
+ * CONNECT_REQUEST:
+ *     uint32 protocol version (PROTOCOL_VERSION or MULTIPLEXED_PROTOCOL_VERSION)
+ *     [uint32 options (ConnectOption bit mask)]
+ * CONNECT_RESPONSE (only if the options were sent):
+ *     uint32 accepted options
+ *     if CONNECT_OPTION_SHARED_MEMORY was accepted:
+ *         string shared memory object name, uint32 number of slots, uint32 slot size
+ *
+ * With MULTIPLEXED_PROTOCOL_VERSION, the messages after the response use the
+ * multiplexed header (see ArrayAcqProtocol). The stream frames carry the
+ * request id of START_STREAM_REQUEST.
+ *
+ * The headers, CONNECT_REQUEST and CONNECT_RESPONSE are always big-endian.
+ * If CONNECT_OPTION_LITTLE_ENDIAN is accepted, the data of the next messages
+ * (including the samples in the shared memory slots) are little-endian.
+ *
+ * With the shared memory transport, GET_SIGNAL_REQUEST is answered with
+ * GET_SIGNAL_SHARED_MEMORY_RESPONSE:
+ *     uint32 slot index, uint32 sequence number, uint32 number of samples
+ * The int16 samples are in the slot.
+ *
+ * With CONNECT_OPTION_COMPRESSION (and without the shared memory transport),
+ * GET_SIGNAL_REQUEST is answered with GET_SIGNAL_COMPRESSED_RESPONSE,
+ * containing the signal encoded by SignalCompressor (one block per channel).
+ * If the compression helpers are still encoding blocks when the handler
+ * returns, compressing() is true and no other message is processed until
+ * finishCompression() is called.
+ *
+ * With CONNECT_OPTION_PACKED_12BIT (and without the shared memory transport),
+ * GET_SIGNAL_REQUEST is answered with GET_SIGNAL_PACKED_RESPONSE:
+ *     uint32 number of samples, 12-bit packed samples (see SamplePacking)
+ * The option is only accepted if the device samples fit in 12 bits, and
+ * if CONNECT_OPTION_COMPRESSION is not requested.
+ *
+ * START_STREAM_REQUEST:
+ *     float frame rate (Hz, 0: as fast as possible)
+ * After the OK_RESPONSE, the server sends STREAM_SIGNAL_RESPONSE messages:
+ *     uint32 sequence number, int16 array
+ * (GET_SIGNAL_SHARED_MEMORY_RESPONSE with the shared memory transport),
+ * until STOP_STREAM_REQUEST is received. Other requests may be sent during
+ * the stream. STOP_STREAM_REQUEST is answered with OK_RESPONSE after the
+ * last frame (with the multiplexed header, after its last fragment). If a frame cannot be generated (device error or memory
+ * budget), it is replaced by an ERROR_RESPONSE and the stream ends.
+ *
+ * GET_SIGNAL_BATCH_REQUEST:
+ *     uint32 number of frames
+ * GET_SIGNAL_BATCH_RESPONSE (always sent through TCP):
+ *     uint32 number of frames, int16 array with the consecutive frames
+ *
+ * GET_SIGNAL_REGION_REQUEST:
+ *     string channel mask ('0' or '1' for each channel, empty: all the channels)
+ *     uint32 first sample, uint32 number of samples (per channel)
+ * GET_SIGNAL_REGION_RESPONSE (always sent through TCP, without compression or packing):
+ *     uint32 number of channels, uint32 number of samples per channel,
+ *     int16 array with the selected samples of each selected channel
+ *
+ * SET_DECIMATION_REQUEST:
+ *     uint32 decimation factor (1: disabled)
+ * With a factor > 1 (and without the shared memory transport), each channel
+ * is low-pass filtered and decimated by SignalDecimator. GET_SIGNAL_REQUEST
+ * is answered with GET_SIGNAL_DECIMATED_RESPONSE (without compression or packing):
+ *     uint32 decimation factor, float output sampling frequency (Hz),
+ *     uint32 number of samples per channel, int16 array
+ * and the int16 arrays of STREAM_SIGNAL_RESPONSE contain the decimated
+ * channels. The number of samples per channel is
+ * ceil(signal length / decimation factor).
+ *
+ * SET_CONFIGURATION_REQUEST:
+ *     uint32 number of items
+ *     for each item:
+ *         uint32 message type (SET_*_REQUEST or EXEC_*_REQUEST, including SET_DECIMATION_REQUEST)
+ *         uint32 data size
+ *         data (the same as in the individual request)
+ * All the items are decoded and checked before any of them is applied to
+ * the device, so a malformed request leaves the device unchanged. The items
+ * are then applied in order. The response is a single OK_RESPONSE, or an
+ * ERROR_RESPONSE. The application is not atomic: if the device fails to
+ * apply an item, the previous items remain applied, the next ones are not
+ * applied, and the error message starts with "Configuration item <index>:"
+ * (zero-based).
+ *
+ * GET_SERVER_STATS_REQUEST (no data):
+ * GET_SERVER_STATS_RESPONSE:
+ *     string server statistics, in the Prometheus text exposition format
+ *     (see ServerStatistics)
+ *
+ * The latency of each request is recorded in statistics(), by phase (see
+ * MessageStatistics). The stream frames are accounted to START_STREAM_REQUEST.
+ * The send phase includes the wait for the acquisition time (takeDelay()).
+ * The heap allocations made by each request are also counted.
+ *
+ * The data size of the requests with fixed fields is limited to
+ * MAX_FIXED_REQUEST_DATA_SIZE, and the data size of the other requests is
+ * limited by setMaxRequestDataSize(). Larger requests, and the large
+ * requests that would exceed the memory budget of the session, close the
+ * connection before their data are received. bufferCapacity() also counts
+ * the scratch storage of the session and the shared memory ring. The
+ * requests that would grow them beyond the budget are rejected: the element
+ * masks and the delay arrays close the connection, SET_CONFIGURATION_REQUEST
+ * and GET_SIGNAL_REQUEST are answered with ERROR_RESPONSE, the stream is
+ * ended, and CONNECT_OPTION_SHARED_MEMORY is not accepted. The delay arrays of
+ * SET_RECEIVE_DELAYS_REQUEST and SET_TRANSMIT_DELAYS_REQUEST are decoded
+ * in chunks as they arrive, without storing the complete message.
+ *
+ * The requests are decoded into scratch storage that is kept by the session,
+ * so in steady state the handlers do not allocate. The exceptions are
+ * GET_SERVER_STATS_REQUEST, the errors reported by exceptions, the debug log,
+ * and the tasks posted to the compression helpers.
+ */
 template<typename AcqDevice>
 class ArrayAcqServerProtocol : private ArrayAcqProtocol {
 public:
-	ArrayAcqServerProtocol(AcqDevice& acqDevice) : acqDevice_(acqDevice) {}
+	typedef std::chrono::steady_clock Clock;
+
+	ArrayAcqServerProtocol(AcqDevice& acqDevice)
+			: acqDevice_(acqDevice)
+			, serverStatistics_()
+			, numConfigurationItems_()
+			, numDecodedDelays_()
+			, localClient_()
+			, compression_()
+			, packed12Bit_()
+			, compressing_()
+			, compressionAllocationCount_()
+			, disconnectRequested_()
+			, delay_()
+			, deviceTime_()
+			, streaming_()
+			, streamRequestId_()
+			, streamSequence_()
+			, streamFramePeriod_()
+			, framesSent_()
+			, signalTime_()
+	{
+		setMaxDataSize(MAX_FIXED_REQUEST_DATA_SIZE);
+		setMaxRequestDataSize(DEFAULT_MAX_REQUEST_DATA_SIZE);
+		setChunked(SET_RECEIVE_DELAYS_REQUEST);
+		setChunked(SET_TRANSMIT_DELAYS_REQUEST);
+	}
 	~ArrayAcqServerProtocol() {}
 
-	void exec(boost::asio::ip::tcp::socket& socket);
+	using ArrayAcqProtocol::inputBuffer;
+	using ArrayAcqProtocol::inputReceived;
+	using ArrayAcqProtocol::inputStorage;
+	using ArrayAcqProtocol::outputPending;
+	using ArrayAcqProtocol::outputQueueSize;
+	using ArrayAcqProtocol::getOutputBuffers;
+	using ArrayAcqProtocol::outputSent;
+	using ArrayAcqProtocol::statistics;
+	using ArrayAcqProtocol::resetStatistics;
+	using ArrayAcqProtocol::bytesReceived;
+	using ArrayAcqProtocol::bytesSent;
+	using ArrayAcqProtocol::setRawBufferPool;
+	using ArrayAcqProtocol::setMemoryBudget;
+
+	void processMessages();
+	// Returns true if processMessages() has stopped because the next message is incomplete.
+	bool needsInput() const;
+
+	// Data size limit of the requests with variable size (masks, delays,
+	// regions and configurations).
+	void setMaxRequestDataSize(boost::uint32_t maxDataSize);
+	// Enables the shared memory transport.
+	void setLocalClient(bool localClient) { localClient_ = localClient; }
+	// The signal blocks may be compressed by numHelpers tasks posted through executor.
+	// completion is called in the thread of a helper when compressing() becomes
+	// ready to be finished. It must not call finishCompression() directly.
+	void setCompressionExecutor(SignalCompressor::Executor executor, unsigned int numHelpers,
+					std::function<void()> completion) {
+		signalCompressor_.setExecutor(std::move(executor), numHelpers, std::move(completion));
+	}
+	bool compressing() const { return compressing_; }
+	// Sends the compressed signal, after the completion function has been called.
+	void finishCompression();
+	// For GET_SERVER_STATS_REQUEST. update is called before the statistics
+	// are read, to publish the counters of this session.
+	void setServerStatistics(const ServerStatistics* serverStatistics, std::function<void()> update) {
+		serverStatistics_ = serverStatistics;
+		updateServerStatistics_ = std::move(update);
+	}
+	bool disconnectRequested() const { return disconnectRequested_; }
+	// Returns the time to wait before the queued responses may be sent,
+	// and before processMessages() may be called again (emulates the acquisition time).
+	Clock::duration takeDelay();
+	bool streaming() const { return streaming_; }
+	Clock::duration streamFramePeriod() const { return streamFramePeriod_; }
+	void sendStreamSignal();
+
+	boost::uint64_t framesSent() const { return framesSent_; }
+	// Time spent by the device generating the frames.
+	Clock::duration signalTime() const { return signalTime_; }
+	// Includes the scratch storage of the session and the shared memory ring.
+	std::size_t bufferCapacity() const override;
 private:
 	ArrayAcqServerProtocol(const ArrayAcqServerProtocol&);
 	ArrayAcqServerProtocol& operator=(const ArrayAcqServerProtocol&);
 
-	void sendErrorResponse(const std::exception& e, boost::asio::ip::tcp::socket& socket);
+	enum {
+		SHARED_MEMORY_NUM_SLOTS = 8,
+		MAX_STREAM_FRAME_RATE = 100000, // Hz
+		MAX_BATCH_DATA_SIZE = 64 * 1024 * 1024, // bytes
+		MAX_CONFIGURATION_ITEMS = 256,
+		MAX_DECIMATION_FACTOR = 64,
+		MAX_OUTPUT_QUEUE_SIZE = 4 * 1024 * 1024, // bytes, stop processing requests above this
+		MAX_FIXED_REQUEST_DATA_SIZE = 64, // bytes
+		DEFAULT_MAX_REQUEST_DATA_SIZE = 4 * 1024 * 1024 // bytes
+	};
+
+	// Adds its lifetime to the given duration.
+	class DeviceTimer {
+	public:
+		explicit DeviceTimer(Clock::duration& time) : time_(time), start_(Clock::now()) {}
+		~DeviceTimer() { time_ += Clock::now() - start_; }
+	private:
+		DeviceTimer(const DeviceTimer&) = delete;
+		DeviceTimer& operator=(const DeviceTimer&) = delete;
+
+		Clock::duration& time_;
+		const Clock::time_point start_;
+	};
+
+	struct ConfigurationItem {
+		boost::uint32_t type;
+		boost::uint32_t uintValue;
+		float floatValue;
+		std::string stringValue;
+		std::vector<float> floatArray;
+	};
+
+	void processMessage(boost::uint32_t messageType);
+
+	void sendErrorResponse(const std::exception& e);
+	void sendErrorResponse(const char* message);
+
+	void handleConnectRequest();
+	void setByteOrder(RawBuffer::ByteOrder byteOrder);
+
+	void handleGetSignalLengthRequest();
+	void handleGetSignalRequest();
+	void handleGetSignalCompressedRequest();
+	void sendCompressedSignal();
+	void handleGetSignalPackedRequest();
+	void handleGetSignalSharedMemoryRequest();
+	void handleGetSignalBatchRequest();
+	void handleGetSignalRegionRequest();
+	void handleGetSignalDecimatedRequest();
+	void handleGetMaxSampleValueRequest();
+	void handleGetMinSampleValueRequest();
+	void handleGetSamplingFrequencyRequest();
+
+	void handleSetAcquisitionTimeRequest();
+	void handleSetActiveReceiveElementsRequest();
+	void handleSetActiveTransmitElementsRequest();
+	void handleSetBaseElementRequest();
+	void handleSetCenterFrequencyRequest();
+	void handleSetGainRequest();
+	void handleSetReceiveDelaysRequest();
+	void handleSetSamplingFrequencyRequest();
+	void handleSetTransmitDelaysRequest();
+	void handleSetDecimationRequest();
+	bool decodeDelays();
+
+	void handleExecPreConfigurationRequest();
+	void handleExecPostConfigurationRequest();
+	void handleExecPreLoopConfigurationRequest();
+	void handleExecPostLoopConfigurationRequest();
+
+	void handleSetConfigurationRequest();
+	void decodeConfigurationItem(ConfigurationItem& item);
+	void applyConfigurationItem(const ConfigurationItem& item);
+
+	void handleStartStreamRequest();
+	void handleStopStreamRequest();
+
+	void handleGetServerStatsRequest();
+
+	std::size_t numChannels();
+	// Throws UnavailableResourceException if growing a container from
+	// capacity to size bytes would exceed the memory budget.
+	void checkMemoryBudget(std::size_t capacity, std::size_t size);
 
-	void handleConnectRequest(boost::asio::ip::tcp::socket& socket);
+	AcqDevice& acqDevice_;
+	const ServerStatistics* serverStatistics_;
+	std::function<void()> updateServerStatistics_;
+	std::unique_ptr<SharedMemoryRing> sharedMemoryRing_;
+	// Scratch storage, reused by the requests of the session.
+	std::vector<ConfigurationItem> configuration_; // only the first numConfigurationItems_ are valid
+	std::size_t numConfigurationItems_;
+	std::string mask_;
+	std::vector<float> delays_;
+	std::size_t numDecodedDelays_; // of the chunked message being received
+	std::vector<unsigned int> regionChannelList_;
+	bool localClient_;
+	bool compression_;
+	bool packed12Bit_;
+	SignalCompressor signalCompressor_;
+	bool compressing_;
+	Clock::time_point compressionStartTime_; // of the request
+	boost::uint64_t compressionAllocationCount_; // in the request handler
+	SignalDecimator signalDecimator_;
+	std::vector<boost::uint8_t> signalBuffer_;
+	bool disconnectRequested_;
+	Clock::duration delay_;
+	Clock::duration deviceTime_; // in the current message
+	bool streaming_;
+	boost::uint32_t streamRequestId_;
+	boost::uint32_t streamSequence_;
+	Clock::duration streamFramePeriod_;
+	boost::uint64_t framesSent_;
+	Clock::duration signalTime_;
+};
 
-	void handleGetSignalLengthRequest(boost::asio::ip::tcp::socket& socket);
-	void handleGetSignalRequest(boost::asio::ip::tcp::socket& socket);
-	void handleGetMaxSampleValueRequest(boost::asio::ip::tcp::socket& socket);
-	void handleGetMinSampleValueRequest(boost::asio::ip::tcp::socket& socket);
-	void handleGetSamplingFrequencyRequest(boost::asio::ip::tcp::socket& socket);
+/*******************************************************************************
+ * Sets the data size limit of the requests with variable size. The other
+ * requests are limited to MAX_FIXED_REQUEST_DATA_SIZE.
+ */
+template<typename AcqDevice>
+void
+ArrayAcqServerProtocol<AcqDevice>::setMaxRequestDataSize(boost::uint32_t maxDataSize)
+{
+	setMaxDataSize(SET_ACTIVE_RECEIVE_ELEMENTS_REQUEST, maxDataSize);
+	setMaxDataSize(SET_ACTIVE_TRANSMIT_ELEMENTS_REQUEST, maxDataSize);
+	setMaxDataSize(SET_RECEIVE_DELAYS_REQUEST, maxDataSize);
+	setMaxDataSize(SET_TRANSMIT_DELAYS_REQUEST, maxDataSize);
+	setMaxDataSize(GET_SIGNAL_REGION_REQUEST, maxDataSize);
+	setMaxDataSize(SET_CONFIGURATION_REQUEST, maxDataSize);
+}
 
-	void handleSetAcquisitionTimeRequest(boost::asio::ip::tcp::socket& socket);
-	void handleSetActiveReceiveElementsRequest(boost::asio::ip::tcp::socket& socket);
-	void handleSetActiveTransmitElementsRequest(boost::asio::ip::tcp::socket& socket);
-	void handleSetBaseElementRequest(boost::asio::ip::tcp::socket& socket);
-	void handleSetCenterFrequencyRequest(boost::asio::ip::tcp::socket& socket);
-	void handleSetGainRequest(boost::asio::ip::tcp::socket& socket);
-	void handleSetReceiveDelaysRequest(boost::asio::ip::tcp::socket& socket);
-	void handleSetSamplingFrequencyRequest(boost::asio::ip::tcp::socket& socket);
-	void handleSetTransmitDelaysRequest(boost::asio::ip::tcp::socket& socket);
+/*******************************************************************************
+ * Processes the complete messages in the input buffer.
+ *
+ * Stops early after a disconnection request, when a delay is needed,
+ * or when the output queue is too large.
+ */
+template<typename AcqDevice>
+void
+ArrayAcqServerProtocol<AcqDevice>::processMessages()
+{
+	boost::uint32_t messageType;
+	while (needsInput() && receiveMessage(messageType)) {
+		processMessage(messageType);
+	}
+}
 
-	void handleExecPreConfigurationRequest(boost::asio::ip::tcp::socket& socket);
-	void handleExecPostConfigurationRequest(boost::asio::ip::tcp::socket& socket);
-	void handleExecPreLoopConfigurationRequest(boost::asio::ip::tcp::socket& socket);
-	void handleExecPostLoopConfigurationRequest(boost::asio::ip::tcp::socket& socket);
+template<typename AcqDevice>
+bool
+ArrayAcqServerProtocol<AcqDevice>::needsInput() const
+{
+	return !disconnectRequested_ &&
+			!compressing_ &&
+			delay_ == Clock::duration::zero() &&
+			outputQueueSize() < MAX_OUTPUT_QUEUE_SIZE;
+}
 
-	AcqDevice& acqDevice_;
-};
+template<typename AcqDevice>
+typename ArrayAcqServerProtocol<AcqDevice>::Clock::duration
+ArrayAcqServerProtocol<AcqDevice>::takeDelay()
+{
+	const Clock::duration delay = delay_;
+	delay_ = Clock::duration::zero();
+	return delay;
+}
 
 template<typename AcqDevice>
 void
-ArrayAcqServerProtocol<AcqDevice>::exec(boost::asio::ip::tcp::socket& socket)
+ArrayAcqServerProtocol<AcqDevice>::processMessage(boost::uint32_t messageType)
 {
-	for (;;) {
-		boost::uint32_t messageType = receiveMessage(socket);
-		switch (messageType) {
-		case CONNECT_REQUEST:
-			handleConnectRequest(socket);
-			LOG_DEBUG << "CONNECT_REQUEST";
-			break;
-		case DISCONNECT_REQUEST:
-			LOG_DEBUG << "DISCONNECT_REQUEST";
-			return;
+	const Clock::time_point startTime = Clock::now();
+	// A chunked request is recorded once, with its last chunk.
+	const bool lastChunk = dataChunk().last;
+	if (lastChunk) statistics_.record(messageType, MessageStatistics::PHASE_RECEIVE, startTime - receiveTime_);
+	deviceTime_ = Clock::duration::zero();
+	const boost::uint64_t allocationCount = AllocationCounter::count();
+
+	switch (messageType) {
+	case CONNECT_REQUEST:
+		handleConnectRequest();
+		LOG_DEBUG << "CONNECT_REQUEST";
+		break;
+	case DISCONNECT_REQUEST:
+		LOG_DEBUG << "DISCONNECT_REQUEST";
+		disconnectRequested_ = true;
+		break;
+
+	case GET_SIGNAL_LENGTH_REQUEST:
+		handleGetSignalLengthRequest();
+		//LOG_DEBUG << "GET_SIGNAL_LENGTH_REQUEST";
+		break;
+	case GET_SIGNAL_REQUEST:
+		handleGetSignalRequest();
+		//LOG_DEBUG << "GET_SIGNAL_REQUEST";
+		break;
+	case GET_SIGNAL_BATCH_REQUEST:
+		handleGetSignalBatchRequest();
+		//LOG_DEBUG << "GET_SIGNAL_BATCH_REQUEST";
+		break;
+	case GET_SIGNAL_REGION_REQUEST:
+		handleGetSignalRegionRequest();
+		//LOG_DEBUG << "GET_SIGNAL_REGION_REQUEST";
+		break;
+	case GET_MAX_SAMPLE_VALUE_REQUEST:
+		handleGetMaxSampleValueRequest();
+		//LOG_DEBUG << "GET_MAX_SAMPLE_VALUE_REQUEST";
+		break;
+	case GET_MIN_SAMPLE_VALUE_REQUEST:
+		handleGetMinSampleValueRequest();
+		//LOG_DEBUG << "GET_MIN_SAMPLE_VALUE_REQUEST";
+		break;
+	case GET_SAMPLING_FREQUENCY_REQUEST:
+		handleGetSamplingFrequencyRequest();
+		//LOG_DEBUG << "GET_SAMPLING_FREQUENCY_REQUEST";
+		break;
+
+	case SET_ACQUISITION_TIME_REQUEST:
+		handleSetAcquisitionTimeRequest();
+		//LOG_DEBUG << "SET_ACQUISITION_TIME_REQUEST";
+		break;
+	case SET_ACTIVE_RECEIVE_ELEMENTS_REQUEST:
+		handleSetActiveReceiveElementsRequest();
+		//LOG_DEBUG << "SET_ACTIVE_RECEIVE_ELEMENTS_REQUEST";
+		break;
+	case SET_ACTIVE_TRANSMIT_ELEMENTS_REQUEST:
+		handleSetActiveTransmitElementsRequest();
+		//LOG_DEBUG << "SET_ACTIVE_TRANSMIT_ELEMENTS_REQUEST";
+		break;
+	case SET_BASE_ELEMENT_REQUEST:
+		handleSetBaseElementRequest();
+		//LOG_DEBUG << "SET_BASE_ELEMENT_REQUEST";
+		break;
+	case SET_CENTER_FREQUENCY_REQUEST:
+		handleSetCenterFrequencyRequest();
+		//LOG_DEBUG << "SET_CENTER_FREQUENCY_REQUEST";
+		break;
+	case SET_GAIN_REQUEST:
+		handleSetGainRequest();
+		//LOG_DEBUG << "SET_GAIN_REQUEST";
+		break;
+	case SET_RECEIVE_DELAYS_REQUEST:
+		handleSetReceiveDelaysRequest();
+		//LOG_DEBUG << "SET_RECEIVE_DELAYS_REQUEST";
+		break;
+	case SET_SAMPLING_FREQUENCY_REQUEST:
+		handleSetSamplingFrequencyRequest();
+		//LOG_DEBUG << "SET_SAMPLING_FREQUENCY_REQUEST";
+		break;
+	case SET_TRANSMIT_DELAYS_REQUEST:
+		handleSetTransmitDelaysRequest();
+		//LOG_DEBUG << "SET_TRANSMIT_DELAYS_REQUEST";
+		break;
+	case SET_DECIMATION_REQUEST:
+		handleSetDecimationRequest();
+		//LOG_DEBUG << "SET_DECIMATION_REQUEST";
+		break;
+
+	case EXEC_PRE_CONFIGURATION_REQUEST:
+		handleExecPreConfigurationRequest();
+		//LOG_DEBUG << "EXEC_PRE_CONFIGURATION_REQUEST";
+		break;
+	case EXEC_POST_CONFIGURATION_REQUEST:
+		handleExecPostConfigurationRequest();
+		//LOG_DEBUG << "EXEC_POST_CONFIGURATION_REQUEST";
+		break;
+	case EXEC_PRE_LOOP_CONFIGURATION_REQUEST:
+		handleExecPreLoopConfigurationRequest();
+		//LOG_DEBUG << "EXEC_PRE_LOOP_CONFIGURATION_REQUEST";
+		break;
+	case EXEC_POST_LOOP_CONFIGURATION_REQUEST:
+		handleExecPostLoopConfigurationRequest();
+		//LOG_DEBUG << "EXEC_POST_LOOP_CONFIGURATION_REQUEST";
+		break;
+
+	case SET_CONFIGURATION_REQUEST:
+		handleSetConfigurationRequest();
+		//LOG_DEBUG << "SET_CONFIGURATION_REQUEST";
+		break;
+
+	case START_STREAM_REQUEST:
+		handleStartStreamRequest();
+		LOG_DEBUG << "START_STREAM_REQUEST";
+		break;
+	case STOP_STREAM_REQUEST:
+		handleStopStreamRequest();
+		LOG_DEBUG << "STOP_STREAM_REQUEST";
+		break;
+
+	case GET_SERVER_STATS_REQUEST:
+		handleGetServerStatsRequest();
+		//LOG_DEBUG << "GET_SERVER_STATS_REQUEST";
+		break;
+	default:
+		THROW_EXCEPTION(InvalidRequestException, "Invalid request: " << messageType << '.');
+	}
+	if (!lastChunk) return;
+	if (compressing_) {
+		// Recorded by finishCompression().
+		compressionStartTime_ = startTime;
+		compressionAllocationCount_ = AllocationCounter::count() - allocationCount;
+		return;
+	}
+
+	statistics_.record(messageType, MessageStatistics::PHASE_DEVICE, deviceTime_);
+	statistics_.record(messageType, MessageStatistics::PHASE_SERIALIZATION, Clock::now() - startTime - deviceTime_);
+	statistics_.recordAllocations(messageType, AllocationCounter::count() - allocationCount);
+	if (messageType == GET_SIGNAL_REQUEST || messageType == GET_SIGNAL_BATCH_REQUEST ||
+			messageType == GET_SIGNAL_REGION_REQUEST) {
+		signalTime_ += deviceTime_;
+	}
+}
+
+/*******************************************************************************
+ * Queues the next frame of the stream.
+ */
+template<typename AcqDevice>
+void
+ArrayAcqServerProtocol<AcqDevice>::sendStreamSignal()
+{
+	if (!streaming_) return;
 
-		case GET_SIGNAL_LENGTH_REQUEST:
-			handleGetSignalLengthRequest(socket);
-			//LOG_DEBUG << "GET_SIGNAL_LENGTH_REQUEST";
-			break;
-		case GET_SIGNAL_REQUEST:
-			handleGetSignalRequest(socket);
-			//LOG_DEBUG << "GET_SIGNAL_REQUEST";
-			break;
-		case GET_MAX_SAMPLE_VALUE_REQUEST:
-			handleGetMaxSampleValueRequest(socket);
-			//LOG_DEBUG << "GET_MAX_SAMPLE_VALUE_REQUEST";
-			break;
-		case GET_MIN_SAMPLE_VALUE_REQUEST:
-			handleGetMinSampleValueRequest(socket);
-			//LOG_DEBUG << "GET_MIN_SAMPLE_VALUE_REQUEST";
-			break;
-		case GET_SAMPLING_FREQUENCY_REQUEST:
-			handleGetSamplingFrequencyRequest(socket);
-			//LOG_DEBUG << "GET_SAMPLING_FREQUENCY_REQUEST";
-			break;
-
-		case SET_ACQUISITION_TIME_REQUEST:
-			handleSetAcquisitionTimeRequest(socket);
-			//LOG_DEBUG << "SET_ACQUISITION_TIME_REQUEST";
-			break;
-		case SET_ACTIVE_RECEIVE_ELEMENTS_REQUEST:
-			handleSetActiveReceiveElementsRequest(socket);
-			//LOG_DEBUG << "SET_ACTIVE_RECEIVE_ELEMENTS_REQUEST";
-			break;
-		case SET_ACTIVE_TRANSMIT_ELEMENTS_REQUEST:
-			handleSetActiveTransmitElementsRequest(socket);
-			//LOG_DEBUG << "SET_ACTIVE_TRANSMIT_ELEMENTS_REQUEST";
-			break;
-		case SET_BASE_ELEMENT_REQUEST:
-			handleSetBaseElementRequest(socket);
-			//LOG_DEBUG << "SET_BASE_ELEMENT_REQUEST";
-			break;
-		case SET_CENTER_FREQUENCY_REQUEST:
-			handleSetCenterFrequencyRequest(socket);
-			//LOG_DEBUG << "SET_CENTER_FREQUENCY_REQUEST";
-			break;
-		case SET_GAIN_REQUEST:
-			handleSetGainRequest(socket);
-			//LOG_DEBUG << "SET_GAIN_REQUEST";
-			break;
-		case SET_RECEIVE_DELAYS_REQUEST:
-			handleSetReceiveDelaysRequest(socket);
-			//LOG_DEBUG << "SET_RECEIVE_DELAYS_REQUEST";
-			break;
-		case SET_SAMPLING_FREQUENCY_REQUEST:
-			handleSetSamplingFrequencyRequest(socket);
-			//LOG_DEBUG << "SET_SAMPLING_FREQUENCY_REQUEST";
-			break;
-		case SET_TRANSMIT_DELAYS_REQUEST:
-			handleSetTransmitDelaysRequest(socket);
-			//LOG_DEBUG << "SET_TRANSMIT_DELAYS_REQUEST";
-			break;
-
-		case EXEC_PRE_CONFIGURATION_REQUEST:
-			handleExecPreConfigurationRequest(socket);
-			//LOG_DEBUG << "EXEC_PRE_CONFIGURATION_REQUEST";
-			break;
-		case EXEC_POST_CONFIGURATION_REQUEST:
-			handleExecPostConfigurationRequest(socket);
-			//LOG_DEBUG << "EXEC_POST_CONFIGURATION_REQUEST";
-			break;
-		case EXEC_PRE_LOOP_CONFIGURATION_REQUEST:
-			handleExecPreLoopConfigurationRequest(socket);
-			//LOG_DEBUG << "EXEC_PRE_LOOP_CONFIGURATION_REQUEST";
-			break;
-		case EXEC_POST_LOOP_CONFIGURATION_REQUEST:
-			handleExecPostLoopConfigurationRequest(socket);
-			//LOG_DEBUG << "EXEC_POST_LOOP_CONFIGURATION_REQUEST";
-			break;
-		default:
-			THROW_EXCEPTION(InvalidRequestException, "Invalid request: " << messageType << '.');
+	const Clock::time_point startTime = Clock::now();
+	deviceTime_ = Clock::duration::zero();
+	const boost::uint64_t allocationCount = AllocationCounter::count();
+	requestId_ = streamRequestId_;
+	requestType_ = START_STREAM_REQUEST;
+	try {
+		if (sharedMemoryRing_) {
+			boost::uint8_t* slot = sharedMemoryRing_->beginWrite();
+			if (!slot) return; // the client is not consuming the frames, drop this one
+			{
+				const DeviceTimer timer(deviceTime_);
+				acqDevice_.getSignal(slot);
+			}
+			prepareMessage(GET_SIGNAL_SHARED_MEMORY_RESPONSE);
+			dataRawBuffer_.putUInt32(sharedMemoryRing_->writeSlot());
+			dataRawBuffer_.putUInt32(sharedMemoryRing_->writeCount());
+			dataRawBuffer_.putUInt32(acqDevice_.getSignalBufferSize());
+			sharedMemoryRing_->endWrite();
+		} else if (signalDecimator_.factor() > 1) {
+			const std::size_t signalLength = acqDevice_.getSignalLength();
+			const std::size_t n = numChannels();
+			checkMemoryBudget(signalBuffer_.capacity() + signalDecimator_.bufferCapacity(),
+					acqDevice_.getSignalBufferSize() * sizeof(boost::int16_t) +
+					signalDecimator_.requiredBufferCapacity(signalLength));
+			signalBuffer_.resize(acqDevice_.getSignalBufferSize() * sizeof(boost::int16_t));
+			{
+				const DeviceTimer timer(deviceTime_);
+				acqDevice_.getSignal(signalBuffer_.data());
+			}
+			prepareMessage(STREAM_SIGNAL_RESPONSE);
+			dataRawBuffer_.putUInt32(streamSequence_);
+			signalDecimator_.decimate(signalBuffer_.data(), n, signalLength, dataRawBuffer_.byteOrder(),
+						dataRawBuffer_.putInt16ArraySpace(n * signalDecimator_.outputLength(signalLength)));
+		} else {
+			prepareMessage(STREAM_SIGNAL_RESPONSE);
+			dataRawBuffer_.putUInt32(streamSequence_);
+			boost::uint8_t* signal = dataRawBuffer_.putInt16ArraySpace(acqDevice_.getSignalBufferSize());
+			const DeviceTimer timer(deviceTime_);
+			acqDevice_.getSignal(signal);
 		}
+	} catch (std::exception& e) {
+		// The error replaces the frame, and ends the stream.
+		LOG_ERROR << "Stream stopped: " << e.what();
+		streaming_ = false;
+		sendErrorResponse(e);
+		return;
 	}
+	++streamSequence_;
+	sendMessage();
+	++framesSent_;
+	signalTime_ += deviceTime_;
+
+	statistics_.record(START_STREAM_REQUEST, MessageStatistics::PHASE_DEVICE, deviceTime_);
+	statistics_.record(START_STREAM_REQUEST, MessageStatistics::PHASE_SERIALIZATION, Clock::now() - startTime - deviceTime_);
+	statistics_.recordAllocations(START_STREAM_REQUEST, AllocationCounter::count() - allocationCount);
+}
+
+template<typename AcqDevice>
+void
+ArrayAcqServerProtocol<AcqDevice>::sendErrorResponse(const std::exception& e)
+{
+	sendErrorResponse(e.what());
 }
 
 template<typename AcqDevice>
 void
-ArrayAcqServerProtocol<AcqDevice>::sendErrorResponse(const std::exception& e, boost::asio::ip::tcp::socket& socket)
+ArrayAcqServerProtocol<AcqDevice>::sendErrorResponse(const char* message)
 {
 	prepareMessage(ERROR_RESPONSE);
-	dataRawBuffer_.putString(e.what());
-	sendMessage(socket);
+	dataRawBuffer_.putString(message);
+	sendMessage();
 }
 
 template<typename AcqDevice>
 void
-ArrayAcqServerProtocol<AcqDevice>::handleConnectRequest(boost::asio::ip::tcp::socket& socket)
+ArrayAcqServerProtocol<AcqDevice>::handleConnectRequest()
 {
+	// The options of a previous CONNECT_REQUEST are not kept.
+	setByteOrder(RawBuffer::BYTE_ORDER_BIG_ENDIAN);
+	sharedMemoryRing_.reset();
+	compression_ = false;
+	packed12Bit_ = false;
+
 	const boost::uint32_t protocolVersion = dataRawBuffer_.getUInt32();
-	if (protocolVersion == PROTOCOL_VERSION) {
+	if (protocolVersion != PROTOCOL_VERSION && protocolVersion != MULTIPLEXED_PROTOCOL_VERSION) {
+		sendErrorResponse("Invalid protocol version.");
+		return;
+	}
+	if (dataRawBuffer_.atEnd()) {
 		prepareMessage(OK_RESPONSE);
-	} else {
-		prepareMessage(ERROR_RESPONSE);
-		dataRawBuffer_.putString("Invalid protocol version.");
+		sendMessage();
+		setMultiplexed(protocolVersion == MULTIPLEXED_PROTOCOL_VERSION);
+		return;
+	}
+
+	const boost::uint32_t options = dataRawBuffer_.getUInt32();
+	boost::uint32_t acceptedOptions = 0;
+
+	if ((options & CONNECT_OPTION_SHARED_MEMORY) && localClient_) {
+		const std::size_t slotSize = acqDevice_.getSignalBufferSize() * sizeof(boost::int16_t);
+		if (!fitsMemoryBudget(SHARED_MEMORY_NUM_SLOTS * slotSize)) {
+			LOG_WARNING << "Shared memory transport disabled: the ring exceeds the memory budget of the session.";
+		} else {
+			try {
+				sharedMemoryRing_ = std::make_unique<SharedMemoryRing>(SHARED_MEMORY_NUM_SLOTS, slotSize);
+				acceptedOptions |= CONNECT_OPTION_SHARED_MEMORY;
+			} catch (std::exception& e) {
+				LOG_ERROR << "Shared memory transport disabled: " << e.what();
+			}
+		}
+	}
+	if (options & CONNECT_OPTION_COMPRESSION) {
+		compression_ = true;
+		acceptedOptions |= CONNECT_OPTION_COMPRESSION;
+	}
+	if ((options & CONNECT_OPTION_PACKED_12BIT) && !compression_ &&
+			acqDevice_.getMinSampleValue() >= -2048 && acqDevice_.getMaxSampleValue() <= 2047) {
+		packed12Bit_ = true;
+		acceptedOptions |= CONNECT_OPTION_PACKED_12BIT;
+	}
+	if (options & CONNECT_OPTION_LITTLE_ENDIAN) {
+		acceptedOptions |= CONNECT_OPTION_LITTLE_ENDIAN;
+	}
+
+	prepareMessage(CONNECT_RESPONSE);
+	dataRawBuffer_.putUInt32(acceptedOptions);
+	if (sharedMemoryRing_) {
+		dataRawBuffer_.putString(sharedMemoryRing_->name());
+		dataRawBuffer_.putUInt32(sharedMemoryRing_->numSlots());
+		dataRawBuffer_.putUInt32(sharedMemoryRing_->slotSize());
+	}
+	sendMessage();
+	setMultiplexed(protocolVersion == MULTIPLEXED_PROTOCOL_VERSION);
+
+	if (acceptedOptions & CONNECT_OPTION_LITTLE_ENDIAN) {
+		setByteOrder(RawBuffer::BYTE_ORDER_LITTLE_ENDIAN);
 	}
-	sendMessage(socket);
 }
 
 template<typename AcqDevice>
 void
-ArrayAcqServerProtocol<AcqDevice>::handleGetSignalLengthRequest(boost::asio::ip::tcp::socket& socket)
+ArrayAcqServerProtocol<AcqDevice>::setByteOrder(RawBuffer::ByteOrder byteOrder)
+{
+	dataRawBuffer_.setByteOrder(byteOrder);
+	acqDevice_.setSignalByteOrder(byteOrder);
+}
+
+template<typename AcqDevice>
+void
+ArrayAcqServerProtocol<AcqDevice>::handleGetSignalLengthRequest()
 {
 	boost::uint32_t signalLength = 0;
 	try {
+		const DeviceTimer timer(deviceTime_);
 		signalLength = acqDevice_.getSignalLength();
 	} catch (std::exception& e) {
-		sendErrorResponse(e, socket);
+		sendErrorResponse(e);
 		return;
 	}
 
 	prepareMessage(GET_SIGNAL_LENGTH_RESPONSE);
 	dataRawBuffer_.putUInt32(signalLength);
-	sendMessage(socket);
+	sendMessage();
 }
 
 template<typename AcqDevice>
 void
-ArrayAcqServerProtocol<AcqDevice>::handleGetSignalRequest(boost::asio::ip::tcp::socket& socket)
+ArrayAcqServerProtocol<AcqDevice>::handleGetSignalRequest()
 {
-	//const std::vector<float>* dataBuffer = nullptr;
-	const std::vector<boost::int16_t>* dataBuffer = nullptr;
+	if (sharedMemoryRing_) {
+		handleGetSignalSharedMemoryRequest();
+		return;
+	}
+	if (signalDecimator_.factor() > 1) {
+		handleGetSignalDecimatedRequest();
+		return;
+	}
+	if (compression_) {
+		handleGetSignalCompressedRequest();
+		return;
+	}
+	if (packed12Bit_) {
+		handleGetSignalPackedRequest();
+		return;
+	}
+
+	// The device writes the samples directly to the message.
+	prepareMessage(GET_SIGNAL_RESPONSE);
 	try {
-		dataBuffer = &acqDevice_.getSignal();
+		const DeviceTimer timer(deviceTime_);
+		acqDevice_.getSignal(dataRawBuffer_.putInt16ArraySpace(acqDevice_.getSignalBufferSize()));
 	} catch (std::exception& e) {
-		sendErrorResponse(e, socket);
+		sendErrorResponse(e);
 		return;
 	}
+	sendMessage();
+	++framesSent_;
+	delay_ = std::chrono::milliseconds(acqDevice_.getAcquisitionPauseMs());
+}
 
-	prepareMessage(GET_SIGNAL_RESPONSE);
-	//dataRawBuffer_.putFloatArray(*dataBuffer);
-	dataRawBuffer_.putInt16Array(*dataBuffer);
-	sendMessage(socket);
+template<typename AcqDevice>
+void
+ArrayAcqServerProtocol<AcqDevice>::handleGetSignalCompressedRequest()
+{
+	prepareMessage(GET_SIGNAL_COMPRESSED_RESPONSE);
+	try {
+		const std::size_t numSamples = acqDevice_.getSignalBufferSize();
+		checkMemoryBudget(signalBuffer_.capacity() + signalCompressor_.bufferCapacity(),
+				numSamples * sizeof(boost::int16_t) +
+				SignalCompressor::requiredBufferCapacity(numSamples, acqDevice_.getSignalLength()));
+		signalBuffer_.resize(numSamples * sizeof(boost::int16_t));
+		{
+			const DeviceTimer timer(deviceTime_);
+			acqDevice_.getSignal(signalBuffer_.data());
+		}
+		compressing_ = !signalCompressor_.compress(signalBuffer_.data(), numSamples, acqDevice_.getSignalLength(),
+								dataRawBuffer_.byteOrder());
+	} catch (std::exception& e) {
+		sendErrorResponse(e);
+		return;
+	}
+	if (compressing_) return; // the helpers are still encoding blocks
+	sendCompressedSignal();
+}
+
+template<typename AcqDevice>
+void
+ArrayAcqServerProtocol<AcqDevice>::sendCompressedSignal()
+{
+	signalCompressor_.putEncodedSignal(dataRawBuffer_);
+	sendMessage();
+	++framesSent_;
+	delay_ = std::chrono::milliseconds(acqDevice_.getAcquisitionPauseMs());
+}
+
+/*******************************************************************************
+ * Completes the GET_SIGNAL_REQUEST that has left compressing() true.
+ */
+template<typename AcqDevice>
+void
+ArrayAcqServerProtocol<AcqDevice>::finishCompression()
+{
+	if (!compressing_) return;
+	compressing_ = false;
+
+	const boost::uint64_t allocationCount = AllocationCounter::count();
+	sendCompressedSignal();
+
+	statistics_.record(GET_SIGNAL_REQUEST, MessageStatistics::PHASE_DEVICE, deviceTime_);
+	statistics_.record(GET_SIGNAL_REQUEST, MessageStatistics::PHASE_SERIALIZATION,
+				Clock::now() - compressionStartTime_ - deviceTime_);
+	statistics_.recordAllocations(GET_SIGNAL_REQUEST,
+				compressionAllocationCount_ + AllocationCounter::count() - allocationCount);
+	signalTime_ += deviceTime_;
+}
+
+template<typename AcqDevice>
+void
+ArrayAcqServerProtocol<AcqDevice>::handleGetSignalPackedRequest()
+{
+	prepareMessage(GET_SIGNAL_PACKED_RESPONSE);
+	try {
+		const std::size_t numSamples = acqDevice_.getSignalBufferSize();
+		checkMemoryBudget(signalBuffer_.capacity(), numSamples * sizeof(boost::int16_t));
+		signalBuffer_.resize(numSamples * sizeof(boost::int16_t));
+		{
+			const DeviceTimer timer(deviceTime_);
+			acqDevice_.getSignal(signalBuffer_.data());
+		}
+		dataRawBuffer_.putUInt32(numSamples);
+		SamplePacking::pack12(signalBuffer_.data(), numSamples, dataRawBuffer_.byteOrder(),
+					dataRawBuffer_.putSpace(SamplePacking::packed12Size(numSamples)));
+	} catch (std::exception& e) {
+		sendErrorResponse(e);
+		return;
+	}
+	sendMessage();
+	++framesSent_;
+	delay_ = std::chrono::milliseconds(acqDevice_.getAcquisitionPauseMs());
+}
+
+template<typename AcqDevice>
+void
+ArrayAcqServerProtocol<AcqDevice>::handleGetSignalDecimatedRequest()
+{
+	prepareMessage(GET_SIGNAL_DECIMATED_RESPONSE);
+	try {
+		const std::size_t signalLength = acqDevice_.getSignalLength();
+		const std::size_t n = numChannels();
+		const std::size_t outputLength = signalDecimator_.outputLength(signalLength);
+		checkMemoryBudget(signalBuffer_.capacity() + signalDecimator_.bufferCapacity(),
+				acqDevice_.getSignalBufferSize() * sizeof(boost::int16_t) +
+				signalDecimator_.requiredBufferCapacity(signalLength));
+		signalBuffer_.resize(acqDevice_.getSignalBufferSize() * sizeof(boost::int16_t));
+		{
+			const DeviceTimer timer(deviceTime_);
+			acqDevice_.getSignal(signalBuffer_.data());
+		}
+		dataRawBuffer_.putUInt32(signalDecimator_.factor());
+		dataRawBuffer_.putFloat(acqDevice_.getSamplingFrequency() / signalDecimator_.factor());
+		dataRawBuffer_.putUInt32(outputLength);
+		signalDecimator_.decimate(signalBuffer_.data(), n, signalLength, dataRawBuffer_.byteOrder(),
+					dataRawBuffer_.putInt16ArraySpace(n * outputLength));
+	} catch (std::exception& e) {
+		sendErrorResponse(e);
+		return;
+	}
+	sendMessage();
+	++framesSent_;
+	delay_ = std::chrono::milliseconds(acqDevice_.getAcquisitionPauseMs());
+}
+
+template<typename AcqDevice>
+void
+ArrayAcqServerProtocol<AcqDevice>::handleGetSignalSharedMemoryRequest()
+{
+	const std::size_t numSamples = acqDevice_.getSignalBufferSize();
+	try {
+		const DeviceTimer timer(deviceTime_);
+		if (numSamples * sizeof(boost::int16_t) > sharedMemoryRing_->slotSize()) {
+			THROW_EXCEPTION(InvalidStateException, "The signal does not fit in a shared memory slot.");
+		}
+		boost::uint8_t* slot = sharedMemoryRing_->beginWrite();
+		if (!slot) {
+			THROW_EXCEPTION(UnavailableResourceException, "The shared memory ring is full.");
+		}
+		acqDevice_.getSignal(slot);
+	} catch (std::exception& e) {
+		sendErrorResponse(e);
+		return;
+	}
+
+	prepareMessage(GET_SIGNAL_SHARED_MEMORY_RESPONSE);
+	dataRawBuffer_.putUInt32(sharedMemoryRing_->writeSlot());
+	dataRawBuffer_.putUInt32(sharedMemoryRing_->writeCount());
+	dataRawBuffer_.putUInt32(numSamples);
+	sharedMemoryRing_->endWrite();
+	sendMessage();
+	++framesSent_;
+	delay_ = std::chrono::milliseconds(acqDevice_.getAcquisitionPauseMs());
+}
+
+template<typename AcqDevice>
+void
+ArrayAcqServerProtocol<AcqDevice>::handleGetSignalBatchRequest()
+{
+	const boost::uint32_t numFrames = dataRawBuffer_.getUInt32();
+	const std::size_t frameSize = acqDevice_.getSignalBufferSize();
+	if (frameSize == 0) {
+		sendErrorResponse("The signal is empty.");
+		return;
+	}
+	if (numFrames == 0 || numFrames > MAX_BATCH_DATA_SIZE / (frameSize * sizeof(boost::int16_t))) {
+		sendErrorResponse("Invalid number of frames.");
+		return;
+	}
+	if (!fitsMemoryBudget(numFrames * frameSize * sizeof(boost::int16_t))) {
+		sendErrorResponse("The batch exceeds the memory budget of the session.");
+		return;
+	}
+
+	prepareMessage(GET_SIGNAL_BATCH_RESPONSE);
+	dataRawBuffer_.putUInt32(numFrames);
+	try {
+		const DeviceTimer timer(deviceTime_);
+		acqDevice_.getSignalBatch(dataRawBuffer_.putInt16ArraySpace(numFrames * frameSize), numFrames);
+	} catch (std::exception& e) {
+		sendErrorResponse(e);
+		return;
+	}
+	sendMessage();
+	framesSent_ += numFrames;
+	delay_ = std::chrono::milliseconds(acqDevice_.getAcquisitionPauseMs() * numFrames);
+}
+
+/*******************************************************************************
+ * Only the selected samples are generated by the device.
+ */
+template<typename AcqDevice>
+void
+ArrayAcqServerProtocol<AcqDevice>::handleGetSignalRegionRequest()
+{
+	// Valid until the response is prepared.
+	const boost::string_view channelMask = dataRawBuffer_.getStringView();
+	const boost::uint32_t firstSample = dataRawBuffer_.getUInt32();
+	const boost::uint32_t numSamples = dataRawBuffer_.getUInt32();
+
+	const std::size_t signalLength = acqDevice_.getSignalLength();
+	const std::size_t n = numChannels();
+	if (!channelMask.empty() && channelMask.size() != n) {
+		sendErrorResponse("Invalid channel mask size.");
+		return;
+	}
+	regionChannelList_.clear();
+	for (std::size_t i = 0; i < n; ++i) {
+		if (channelMask.empty() || channelMask[i] == '1') {
+			regionChannelList_.push_back(i);
+		} else if (channelMask[i] != '0') {
+			sendErrorResponse("Invalid channel mask.");
+			return;
+		}
+	}
+	if (firstSample > signalLength || numSamples > signalLength - firstSample) {
+		sendErrorResponse("Invalid sample range.");
+		return;
+	}
+
+	prepareMessage(GET_SIGNAL_REGION_RESPONSE);
+	dataRawBuffer_.putUInt32(regionChannelList_.size());
+	dataRawBuffer_.putUInt32(numSamples);
+	try {
+		const DeviceTimer timer(deviceTime_);
+		acqDevice_.getSignalRegion(dataRawBuffer_.putInt16ArraySpace(regionChannelList_.size() * numSamples),
+						regionChannelList_, firstSample, numSamples);
+	} catch (std::exception& e) {
+		sendErrorResponse(e);
+		return;
+	}
+	sendMessage();
+	++framesSent_;
+	delay_ = std::chrono::milliseconds(acqDevice_.getAcquisitionPauseMs());
 }
 
 template<typename AcqDevice>
 void
-ArrayAcqServerProtocol<AcqDevice>::handleGetMaxSampleValueRequest(boost::asio::ip::tcp::socket& socket)
+ArrayAcqServerProtocol<AcqDevice>::handleGetMaxSampleValueRequest()
 {
 	boost::int16_t v;
 	try {
+		const DeviceTimer timer(deviceTime_);
 		v = acqDevice_.getMaxSampleValue();
 	} catch (std::exception& e) {
-		sendErrorResponse(e, socket);
+		sendErrorResponse(e);
 		return;
 	}
 
 	prepareMessage(GET_MAX_SAMPLE_VALUE_RESPONSE);
 	dataRawBuffer_.putInt16(v);
-	sendMessage(socket);
+	sendMessage();
 }
 
 template<typename AcqDevice>
 void
-ArrayAcqServerProtocol<AcqDevice>::handleGetMinSampleValueRequest(boost::asio::ip::tcp::socket& socket)
+ArrayAcqServerProtocol<AcqDevice>::handleGetMinSampleValueRequest()
 {
 	boost::int16_t v;
 	try {
+		const DeviceTimer timer(deviceTime_);
 		v = acqDevice_.getMinSampleValue();
 	} catch (std::exception& e) {
-		sendErrorResponse(e, socket);
+		sendErrorResponse(e);
 		return;
 	}
 
 	prepareMessage(GET_MIN_SAMPLE_VALUE_RESPONSE);
 	dataRawBuffer_.putInt16(v);
-	sendMessage(socket);
+	sendMessage();
 }
 
 template<typename AcqDevice>
 void
-ArrayAcqServerProtocol<AcqDevice>::handleGetSamplingFrequencyRequest(boost::asio::ip::tcp::socket& socket)
+ArrayAcqServerProtocol<AcqDevice>::handleGetSamplingFrequencyRequest()
 {
 	float fs;
 	try {
+		const DeviceTimer timer(deviceTime_);
 		fs = acqDevice_.getSamplingFrequency();
 	} catch (std::exception& e) {
-		sendErrorResponse(e, socket);
+		sendErrorResponse(e);
 		return;
 	}
 
 	prepareMessage(GET_SAMPLING_FREQUENCY_RESPONSE);
 	dataRawBuffer_.putFloat(fs);
-	sendMessage(socket);
+	sendMessage();
 }
 
 template<typename AcqDevice>
 void
-ArrayAcqServerProtocol<AcqDevice>::handleSetAcquisitionTimeRequest(boost::asio::ip::tcp::socket& socket)
+ArrayAcqServerProtocol<AcqDevice>::handleSetAcquisitionTimeRequest()
 {
 	const float acqTime = dataRawBuffer_.getFloat();
 
 	try {
+		const DeviceTimer timer(deviceTime_);
 		acqDevice_.setAcquisitionTime(acqTime);
 	} catch (std::exception& e) {
-		sendErrorResponse(e, socket);
+		sendErrorResponse(e);
 		return;
 	}
 
 	prepareMessage(OK_RESPONSE);
-	sendMessage(socket);
+	sendMessage();
 }
 
 template<typename AcqDevice>
 void
-ArrayAcqServerProtocol<AcqDevice>::handleSetActiveReceiveElementsRequest(boost::asio::ip::tcp::socket& socket)
+ArrayAcqServerProtocol<AcqDevice>::handleSetActiveReceiveElementsRequest()
 {
-	std::string mask;
-	dataRawBuffer_.getString(mask);
+	checkMemoryBudget(mask_.capacity(), dataRawBuffer_.size());
+	dataRawBuffer_.getString(mask_);
 
 	try {
-		acqDevice_.setActiveReceiveElements(mask);
+		const DeviceTimer timer(deviceTime_);
+		acqDevice_.setActiveReceiveElements(mask_);
 	} catch (std::exception& e) {
-		sendErrorResponse(e, socket);
+		sendErrorResponse(e);
 		return;
 	}
 
 	prepareMessage(OK_RESPONSE);
-	sendMessage(socket);
+	sendMessage();
 }
 
 template<typename AcqDevice>
 void
-ArrayAcqServerProtocol<AcqDevice>::handleSetActiveTransmitElementsRequest(boost::asio::ip::tcp::socket& socket)
+ArrayAcqServerProtocol<AcqDevice>::handleSetActiveTransmitElementsRequest()
 {
-	std::string mask;
-	dataRawBuffer_.getString(mask);
+	checkMemoryBudget(mask_.capacity(), dataRawBuffer_.size());
+	dataRawBuffer_.getString(mask_);
 
 	try {
-		acqDevice_.setActiveTransmitElements(mask);
+		const DeviceTimer timer(deviceTime_);
+		acqDevice_.setActiveTransmitElements(mask_);
 	} catch (std::exception& e) {
-		sendErrorResponse(e, socket);
+		sendErrorResponse(e);
 		return;
 	}
 
 	prepareMessage(OK_RESPONSE);
-	sendMessage(socket);
+	sendMessage();
 }
 
 template<typename AcqDevice>
 void
-ArrayAcqServerProtocol<AcqDevice>::handleSetBaseElementRequest(boost::asio::ip::tcp::socket& socket)
+ArrayAcqServerProtocol<AcqDevice>::handleSetBaseElementRequest()
 {
 	const boost::uint32_t baseElement = dataRawBuffer_.getUInt32();
 
 	try {
+		const DeviceTimer timer(deviceTime_);
 		acqDevice_.setBaseElement(baseElement);
 	} catch (std::exception& e) {
-		sendErrorResponse(e, socket);
+		sendErrorResponse(e);
 		return;
 	}
 
 	prepareMessage(OK_RESPONSE);
-	sendMessage(socket);
+	sendMessage();
 }
 
 template<typename AcqDevice>
 void
-ArrayAcqServerProtocol<AcqDevice>::handleSetCenterFrequencyRequest(boost::asio::ip::tcp::socket& socket)
+ArrayAcqServerProtocol<AcqDevice>::handleSetCenterFrequencyRequest()
 {
 	const float fc = dataRawBuffer_.getFloat();
 	const int numPulses = static_cast<int>(dataRawBuffer_.getUInt32());
 
 	try {
+		const DeviceTimer timer(deviceTime_);
 		acqDevice_.setCenterFrequency(fc, numPulses);
 	} catch (std::exception& e) {
-		sendErrorResponse(e, socket);
+		sendErrorResponse(e);
 		return;
 	}
 
 	prepareMessage(OK_RESPONSE);
-	sendMessage(socket);
+	sendMessage();
 }
 
 template<typename AcqDevice>
 void
-ArrayAcqServerProtocol<AcqDevice>::handleSetGainRequest(boost::asio::ip::tcp::socket& socket)
+ArrayAcqServerProtocol<AcqDevice>::handleSetGainRequest()
 {
 	const float gain = dataRawBuffer_.getFloat();
 
 	try {
+		const DeviceTimer timer(deviceTime_);
 		acqDevice_.setGain(gain);
 	} catch (std::exception& e) {
-		sendErrorResponse(e, socket);
+		sendErrorResponse(e);
 		return;
 	}
 
 	prepareMessage(OK_RESPONSE);
-	sendMessage(socket);
+	sendMessage();
 }
 
 template<typename AcqDevice>
 void
-ArrayAcqServerProtocol<AcqDevice>::handleSetReceiveDelaysRequest(boost::asio::ip::tcp::socket& socket)
+ArrayAcqServerProtocol<AcqDevice>::handleSetReceiveDelaysRequest()
 {
-	std::vector<float> delays;
-	dataRawBuffer_.getFloatArray(delays);
+	if (!decodeDelays()) return;
 
 	try {
-		acqDevice_.setReceiveDelays(delays);
+		const DeviceTimer timer(deviceTime_);
+		acqDevice_.setReceiveDelays(delays_);
 	} catch (std::exception& e) {
-		sendErrorResponse(e, socket);
+		sendErrorResponse(e);
 		return;
 	}
 
 	prepareMessage(OK_RESPONSE);
-	sendMessage(socket);
+	sendMessage();
 }
 
 template<typename AcqDevice>
 void
-ArrayAcqServerProtocol<AcqDevice>::handleSetSamplingFrequencyRequest(boost::asio::ip::tcp::socket& socket)
+ArrayAcqServerProtocol<AcqDevice>::handleSetSamplingFrequencyRequest()
 {
 	const float fs = dataRawBuffer_.getFloat();
 	LOG_DEBUG << "fs = " << fs;
 
 	try {
+		const DeviceTimer timer(deviceTime_);
 		acqDevice_.setSamplingFrequency(fs);
 	} catch (std::exception& e) {
-		sendErrorResponse(e, socket);
+		sendErrorResponse(e);
 		return;
 	}
 
 	prepareMessage(OK_RESPONSE);
-	sendMessage(socket);
+	sendMessage();
 }
 
 template<typename AcqDevice>
 void
-ArrayAcqServerProtocol<AcqDevice>::handleSetTransmitDelaysRequest(boost::asio::ip::tcp::socket& socket)
+ArrayAcqServerProtocol<AcqDevice>::handleSetTransmitDelaysRequest()
 {
-	std::vector<float> delays;
-	dataRawBuffer_.getFloatArray(delays);
+	if (!decodeDelays()) return;
 
 	try {
-		acqDevice_.setTransmitDelays(delays);
+		const DeviceTimer timer(deviceTime_);
+		acqDevice_.setTransmitDelays(delays_);
 	} catch (std::exception& e) {
-		sendErrorResponse(e, socket);
+		sendErrorResponse(e);
+		return;
+	}
+
+	prepareMessage(OK_RESPONSE);
+	sendMessage();
+}
+
+/*******************************************************************************
+ * Decodes the delay array of SET_RECEIVE_DELAYS_REQUEST or
+ * SET_TRANSMIT_DELAYS_REQUEST into delays_, one chunk at a time.
+ *
+ * Returns true after the last chunk.
+ */
+template<typename AcqDevice>
+bool
+ArrayAcqServerProtocol<AcqDevice>::decodeDelays()
+{
+	const DataChunk& chunk = dataChunk();
+	if (chunk.offset == 0) {
+		const boost::uint32_t numDelays = dataRawBuffer_.getUInt32();
+		if (chunk.messageDataSize != sizeof(boost::uint32_t) + std::size_t(numDelays) * sizeof(float)) {
+			THROW_EXCEPTION(InvalidRequestException, "Wrong data size for the delay array.");
+		}
+		checkMemoryBudget(delays_.capacity() * sizeof(float), std::size_t(numDelays) * sizeof(float));
+		delays_.resize(numDelays);
+		numDecodedDelays_ = 0;
+	}
+
+	const std::size_t n = (dataRawBuffer_.size() - dataRawBuffer_.readPosition()) / sizeof(float);
+	dataRawBuffer_.getFloatArrayElements(delays_.data() + numDecodedDelays_, n);
+	numDecodedDelays_ += n;
+	return chunk.last;
+}
+
+template<typename AcqDevice>
+void
+ArrayAcqServerProtocol<AcqDevice>::handleSetDecimationRequest()
+{
+	const boost::uint32_t factor = dataRawBuffer_.getUInt32();
+	if (factor == 0 || factor > MAX_DECIMATION_FACTOR) {
+		sendErrorResponse("Invalid decimation factor.");
 		return;
 	}
 
+	signalDecimator_.setFactor(factor);
+
 	prepareMessage(OK_RESPONSE);
-	sendMessage(socket);
+	sendMessage();
 }
 
 template<typename AcqDevice>
 void
-ArrayAcqServerProtocol<AcqDevice>::handleExecPreConfigurationRequest(boost::asio::ip::tcp::socket& socket)
+ArrayAcqServerProtocol<AcqDevice>::handleExecPreConfigurationRequest()
 {
 	try {
+		const DeviceTimer timer(deviceTime_);
 		acqDevice_.execPreConfiguration();
 	} catch (std::exception& e) {
-		sendErrorResponse(e, socket);
+		sendErrorResponse(e);
 		return;
 	}
 
 	prepareMessage(OK_RESPONSE);
-	sendMessage(socket);
+	sendMessage();
 }
 
 template<typename AcqDevice>
 void
-ArrayAcqServerProtocol<AcqDevice>::handleExecPostConfigurationRequest(boost::asio::ip::tcp::socket& socket)
+ArrayAcqServerProtocol<AcqDevice>::handleExecPostConfigurationRequest()
 {
 	try {
+		const DeviceTimer timer(deviceTime_);
 		acqDevice_.execPostConfiguration();
 	} catch (std::exception& e) {
-		sendErrorResponse(e, socket);
+		sendErrorResponse(e);
 		return;
 	}
 
 	prepareMessage(OK_RESPONSE);
-	sendMessage(socket);
+	sendMessage();
 }
 
 template<typename AcqDevice>
 void
-ArrayAcqServerProtocol<AcqDevice>::handleExecPreLoopConfigurationRequest(boost::asio::ip::tcp::socket& socket)
+ArrayAcqServerProtocol<AcqDevice>::handleExecPreLoopConfigurationRequest()
 {
 	try {
+		const DeviceTimer timer(deviceTime_);
 		acqDevice_.execPreLoopConfiguration();
 	} catch (std::exception& e) {
-		sendErrorResponse(e, socket);
+		sendErrorResponse(e);
 		return;
 	}
 
 	prepareMessage(OK_RESPONSE);
-	sendMessage(socket);
+	sendMessage();
 }
 
 template<typename AcqDevice>
 void
-ArrayAcqServerProtocol<AcqDevice>::handleExecPostLoopConfigurationRequest(boost::asio::ip::tcp::socket& socket)
+ArrayAcqServerProtocol<AcqDevice>::handleExecPostLoopConfigurationRequest()
 {
 	try {
+		const DeviceTimer timer(deviceTime_);
 		acqDevice_.execPostLoopConfiguration();
 	} catch (std::exception& e) {
-		sendErrorResponse(e, socket);
+		sendErrorResponse(e);
 		return;
 	}
 
 	prepareMessage(OK_RESPONSE);
-	sendMessage(socket);
+	sendMessage();
 }
 
+template<typename AcqDevice>
+void
+ArrayAcqServerProtocol<AcqDevice>::handleSetConfigurationRequest()
+{
+	try {
+		const boost::uint32_t numItems = dataRawBuffer_.getUInt32();
+		if (numItems > MAX_CONFIGURATION_ITEMS) {
+			THROW_EXCEPTION(InvalidRequestException, "Too many configuration items: " << numItems << '.');
+		}
+		// The items are not destroyed, to keep the capacity of their containers.
+		checkMemoryBudget(configuration_.capacity() * sizeof(ConfigurationItem), numItems * sizeof(ConfigurationItem));
+		if (configuration_.size() < numItems) configuration_.resize(numItems);
+		numConfigurationItems_ = numItems;
+		for (std::size_t i = 0; i < numItems; ++i) {
+			decodeConfigurationItem(configuration_[i]);
+		}
+		if (!dataRawBuffer_.atEnd()) {
+			THROW_EXCEPTION(InvalidRequestException, "Extra data after the configuration items.");
+		}
+
+	} catch (std::exception& e) {
+		sendErrorResponse(e);
+		return;
+	}
+
+	std::size_t i = 0;
+	try {
+		const DeviceTimer timer(deviceTime_);
+		for ( ; i < numConfigurationItems_; ++i) {
+			applyConfigurationItem(configuration_[i]);
+		}
+	} catch (std::exception& e) {
+		// The device has no way to restore the previous state.
+		std::ostringstream out;
+		out << "Configuration item " << i << ": " << e.what();
+		sendErrorResponse(out.str().c_str());
+		return;
+	}
+
+	prepareMessage(OK_RESPONSE);
+	sendMessage();
+}
+
+template<typename AcqDevice>
+void
+ArrayAcqServerProtocol<AcqDevice>::decodeConfigurationItem(ConfigurationItem& item)
+{
+	item.type = dataRawBuffer_.getUInt32();
+	const boost::uint32_t dataSize = dataRawBuffer_.getUInt32();
+	const std::size_t begin = dataRawBuffer_.readPosition();
+
+	switch (item.type) {
+	case SET_BASE_ELEMENT_REQUEST:
+		item.uintValue = dataRawBuffer_.getUInt32();
+		break;
+	case SET_DECIMATION_REQUEST:
+		item.uintValue = dataRawBuffer_.getUInt32();
+		if (item.uintValue == 0 || item.uintValue > MAX_DECIMATION_FACTOR) {
+			THROW_EXCEPTION(InvalidRequestException, "Invalid decimation factor: " << item.uintValue << '.');
+		}
+		break;
+	case SET_ACQUISITION_TIME_REQUEST: // falls through
+	case SET_GAIN_REQUEST:             // falls through
+	case SET_SAMPLING_FREQUENCY_REQUEST:
+		item.floatValue = dataRawBuffer_.getFloat();
+		break;
+	case SET_CENTER_FREQUENCY_REQUEST:
+		item.floatValue = dataRawBuffer_.getFloat();
+		item.uintValue = dataRawBuffer_.getUInt32();
+		break;
+	case SET_ACTIVE_RECEIVE_ELEMENTS_REQUEST: // falls through
+	case SET_ACTIVE_TRANSMIT_ELEMENTS_REQUEST:
+		checkMemoryBudget(item.stringValue.capacity(), dataSize);
+		dataRawBuffer_.getString(item.stringValue);
+		break;
+	case SET_RECEIVE_DELAYS_REQUEST: // falls through
+	case SET_TRANSMIT_DELAYS_REQUEST:
+		checkMemoryBudget(item.floatArray.capacity() * sizeof(float), dataSize);
+		dataRawBuffer_.getFloatArray(item.floatArray);
+		break;
+	case EXEC_PRE_CONFIGURATION_REQUEST:      // falls through
+	case EXEC_POST_CONFIGURATION_REQUEST:     // falls through
+	case EXEC_PRE_LOOP_CONFIGURATION_REQUEST: // falls through
+	case EXEC_POST_LOOP_CONFIGURATION_REQUEST:
+		break;
+	default:
+		THROW_EXCEPTION(InvalidRequestException, "Invalid configuration item: " << item.type << '.');
+	}
+
+	if (dataRawBuffer_.readPosition() - begin != dataSize) {
+		THROW_EXCEPTION(InvalidRequestException, "Wrong data size for the configuration item " << item.type << '.');
+	}
+}
+
+template<typename AcqDevice>
+void
+ArrayAcqServerProtocol<AcqDevice>::applyConfigurationItem(const ConfigurationItem& item)
+{
+	switch (item.type) {
+	case SET_ACQUISITION_TIME_REQUEST:
+		acqDevice_.setAcquisitionTime(item.floatValue);
+		break;
+	case SET_ACTIVE_RECEIVE_ELEMENTS_REQUEST:
+		acqDevice_.setActiveReceiveElements(item.stringValue);
+		break;
+	case SET_ACTIVE_TRANSMIT_ELEMENTS_REQUEST:
+		acqDevice_.setActiveTransmitElements(item.stringValue);
+		break;
+	case SET_BASE_ELEMENT_REQUEST:
+		acqDevice_.setBaseElement(item.uintValue);
+		break;
+	case SET_CENTER_FREQUENCY_REQUEST:
+		acqDevice_.setCenterFrequency(item.floatValue, static_cast<int>(item.uintValue));
+		break;
+	case SET_GAIN_REQUEST:
+		acqDevice_.setGain(item.floatValue);
+		break;
+	case SET_RECEIVE_DELAYS_REQUEST:
+		acqDevice_.setReceiveDelays(item.floatArray);
+		break;
+	case SET_SAMPLING_FREQUENCY_REQUEST:
+		acqDevice_.setSamplingFrequency(item.floatValue);
+		break;
+	case SET_TRANSMIT_DELAYS_REQUEST:
+		acqDevice_.setTransmitDelays(item.floatArray);
+		break;
+	case SET_DECIMATION_REQUEST:
+		signalDecimator_.setFactor(item.uintValue);
+		break;
+	case EXEC_PRE_CONFIGURATION_REQUEST:
+		acqDevice_.execPreConfiguration();
+		break;
+	case EXEC_POST_CONFIGURATION_REQUEST:
+		acqDevice_.execPostConfiguration();
+		break;
+	case EXEC_PRE_LOOP_CONFIGURATION_REQUEST:
+		acqDevice_.execPreLoopConfiguration();
+		break;
+	case EXEC_POST_LOOP_CONFIGURATION_REQUEST:
+		acqDevice_.execPostLoopConfiguration();
+		break;
+	}
+}
+
+template<typename AcqDevice>
+void
+ArrayAcqServerProtocol<AcqDevice>::handleStartStreamRequest()
+{
+	const float frameRate = dataRawBuffer_.getFloat();
+	if (!(frameRate >= 0.0f && frameRate <= MAX_STREAM_FRAME_RATE)) {
+		sendErrorResponse("Invalid stream frame rate.");
+		return;
+	}
+
+	streamFramePeriod_ = (frameRate > 0.0f) ?
+		std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / frameRate)) :
+		Clock::duration::zero();
+	streamRequestId_ = requestId_;
+	streamSequence_ = 0;
+	streaming_ = true;
+
+	prepareMessage(OK_RESPONSE);
+	sendMessage();
+}
+
+template<typename AcqDevice>
+void
+ArrayAcqServerProtocol<AcqDevice>::handleStopStreamRequest()
+{
+	streaming_ = false;
+
+	// Not before the last fragment of the last frame.
+	prepareMessage(OK_RESPONSE);
+	sendMessageAfterFragments();
+}
+
+template<typename AcqDevice>
+void
+ArrayAcqServerProtocol<AcqDevice>::handleGetServerStatsRequest()
+{
+	if (!serverStatistics_) {
+		sendErrorResponse("The server statistics are not available.");
+		return;
+	}
+
+	if (updateServerStatistics_) updateServerStatistics_();
+	std::ostringstream out;
+	serverStatistics_->writeMetrics(out);
+
+	prepareMessage(GET_SERVER_STATS_RESPONSE);
+	dataRawBuffer_.putString(out.str());
+	sendMessage();
+}
+
+template<typename AcqDevice>
+std::size_t
+ArrayAcqServerProtocol<AcqDevice>::bufferCapacity() const
+{
+	std::size_t capacity = ArrayAcqProtocol::bufferCapacity() +
+				signalBuffer_.capacity() +
+				mask_.capacity() +
+				delays_.capacity() * sizeof(float) +
+				regionChannelList_.capacity() * sizeof(unsigned int) +
+				configuration_.capacity() * sizeof(ConfigurationItem) +
+				signalCompressor_.bufferCapacity() +
+				signalDecimator_.bufferCapacity();
+	for (const ConfigurationItem& item : configuration_) {
+		capacity += item.stringValue.capacity() + item.floatArray.capacity() * sizeof(float);
+	}
+	if (sharedMemoryRing_) {
+		capacity += sharedMemoryRing_->numSlots() * sharedMemoryRing_->slotSize();
+	}
+	return capacity;
+}
+
+template<typename AcqDevice>
+void
+ArrayAcqServerProtocol<AcqDevice>::checkMemoryBudget(std::size_t capacity, std::size_t size)
+{
+	if (size > capacity && !fitsMemoryBudget(size - capacity)) {
+		THROW_EXCEPTION(UnavailableResourceException, "The request exceeds the memory budget of the session (" <<
+					memoryBudget() << " bytes).");
+	}
+}
+
+template<typename AcqDevice>
+std::size_t
+ArrayAcqServerProtocol<AcqDevice>::numChannels()
+{
+	const std::size_t signalLength = acqDevice_.getSignalLength();
+	return (signalLength > 0) ? acqDevice_.getSignalBufferSize() / signalLength : 0;
+}
 
 } // namespace Lab
 
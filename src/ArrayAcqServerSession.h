@@ -0,0 +1,688 @@
+/*
+
+  Copyright (c) 2013, 2017, 2018, 2019 Marcelo Y. Matuda.
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice,
+       this list of conditions and the following disclaimer.
+    2. Redistributions in binary form must reproduce the above copyright
+       notice, this list of conditions and the following disclaimer in the
+       documentation and/or other materials provided with the distribution.
+    3. Neither the name of the copyright holder nor the names of its
+       contributors may be used to endorse or promote products derived from
+       this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+  OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+  WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+  OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+  ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#ifndef ARRAYACQSERVERSESSION_H_
+#define ARRAYACQSERVERSESSION_H_
+
+#include <algorithm>
+#include <cstring> /* strerror */
+#include <exception>
+#include <functional>
+#include <memory>
+#include <sstream>
+#include <typeinfo>
+#include <vector>
+
+#include <boost/asio/bind_executor.hpp>
+#include <boost/asio/buffer.hpp>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/placeholders.hpp>
+#include <boost/asio/posix/stream_descriptor.hpp>
+#include <boost/asio/post.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/asio/strand.hpp>
+#include <boost/asio/write.hpp>
+#include <boost/bind.hpp>
+
+#include <errno.h>
+#include <sys/socket.h> /* msghdr */
+#include <sys/uio.h> /* iovec */
+#include <unistd.h> /* close, dup */
+
+#include "ArrayAcqServerProtocol.h"
+#include "IoUring.h"
+#include "Log.h"
+#include "RawBufferPool.h"
+#include "ServerConfiguration.h"
+#include "ServerStatistics.h"
+
+
+
+namespace Lab {
+
+/*******************************************************************************
+ * A client connection.
+ *
+ * Each session has its own socket, protocol state and device. The device is
+ * copy-constructed from the server's device, and shares its read-only data.
+ *
+ * The session never blocks: reads, writes, the acquisition time, the
+ * stream frame period and the signal compression by the helper tasks are
+ * asynchronous operations, serialized by a strand. The session is kept
+ * alive by its pending operations.
+ *
+ * With the io_uring backend, the socket reads and writes are io_uring
+ * requests. The requests prepared while processing an event are submitted
+ * together, and the completions are signaled to the reactor through an
+ * eventfd. The requests use the buffers of the session, which is kept alive
+ * until all the submitted requests complete, also after an error. If the
+ * eventfd cannot be waited on, the completions are polled every
+ * IO_URING_POLL_PERIOD_MS.
+ *
+ * The counters and message statistics of the protocol are published to the
+ * server statistics every STATISTICS_PERIOD_MS by a timer, also when the
+ * session is idle, and when the session is closed.
+ */
+template<typename AcqDevice>
+class ArrayAcqServerSession : public std::enable_shared_from_this<ArrayAcqServerSession<AcqDevice>> {
+public:
+	ArrayAcqServerSession(boost::asio::io_context& ioContext, const AcqDevice& baseAcqDevice,
+				const ServerConfiguration& config, ServerStatistics& serverStatistics,
+				RawBufferPool& rawBufferPool);
+	~ArrayAcqServerSession() {}
+
+	void start();
+	void stop();
+
+	boost::asio::ip::tcp::socket& socket() { return socket_; }
+private:
+	typedef ArrayAcqServerProtocol<AcqDevice> Protocol;
+	typedef typename Protocol::Clock Clock;
+
+	enum {
+		IO_URING_NUM_ENTRIES = 8,
+		IO_URING_POLL_PERIOD_MS = 10,
+		STATISTICS_PERIOD_MS = 1000
+	};
+	enum IoUringRequest {
+		IO_URING_READ = 1,
+		IO_URING_WRITE
+	};
+
+	ArrayAcqServerSession(const ArrayAcqServerSession&) = delete;
+	ArrayAcqServerSession& operator=(const ArrayAcqServerSession&) = delete;
+
+	void process();
+	void startRead();
+	void startWrite();
+	void startStreamTimer();
+	void startStatisticsTimer();
+	void handleRead(const boost::system::error_code& ec, std::size_t size);
+	void handleWrite(const boost::system::error_code& ec);
+	void handleDelay(const boost::system::error_code& ec);
+	void handleStreamTimer(const boost::system::error_code& ec);
+	void handleStatisticsTimer(const boost::system::error_code& ec);
+	void handleCompression();
+	void close();
+	void publishStatistics(typename Clock::time_point now);
+
+	void prepareIoUringSend();
+	void submitIoUring();
+	void handleIoUringEvent(const boost::system::error_code& ec);
+	void handleIoUringWrite(const IoUring::Completion& completion);
+
+	boost::asio::ip::tcp::socket socket_;
+	boost::asio::strand<boost::asio::io_context::executor_type> strand_;
+	boost::asio::steady_timer delayTimer_;
+	boost::asio::steady_timer streamTimer_;
+	boost::asio::steady_timer statisticsTimer_;
+	AcqDevice acqDevice_;
+	Protocol protocol_;
+	ServerStatistics& serverStatistics_;
+	unsigned int sessionId_; // in serverStatistics_, 0: not registered
+	typename Clock::time_point lastStatisticsTime_;
+	boost::uint64_t lastBytesReceived_;
+	boost::uint64_t lastBytesSent_;
+	std::vector<boost::asio::const_buffer> writeBuffers_;
+	std::unique_ptr<IoUring> ioUring_;
+	boost::asio::posix::stream_descriptor ioUringEvent_;
+	boost::asio::steady_timer ioUringPollTimer_;
+	std::vector<iovec> writeIovecs_;
+	std::size_t writeIovecIndex_; // first iovec not completely sent
+	msghdr writeMsg_;
+	const std::size_t zeroCopySendThreshold_;
+	bool zeroCopyWrite_;
+	unsigned int zeroCopyNotifications_; // pending
+	bool ioUringWaiting_;
+	bool ioUringEventFailed_; // the completions are polled
+	bool ioUringReaping_; // processing the completions
+	typename Clock::time_point nextStreamFrameTime_;
+	bool reading_;
+	bool writing_;
+	bool waiting_; // for the end of the acquisition time
+	bool streamTimerActive_;
+	bool streamFrameDue_;
+	bool closed_;
+};
+
+/*******************************************************************************
+ * Constructor.
+ */
+template<typename AcqDevice>
+ArrayAcqServerSession<AcqDevice>::ArrayAcqServerSession(boost::asio::io_context& ioContext, const AcqDevice& baseAcqDevice,
+								const ServerConfiguration& config, ServerStatistics& serverStatistics,
+								RawBufferPool& rawBufferPool)
+		: socket_(ioContext)
+		, strand_(boost::asio::make_strand(ioContext))
+		, delayTimer_(ioContext)
+		, streamTimer_(ioContext)
+		, statisticsTimer_(ioContext)
+		, acqDevice_(baseAcqDevice)
+		, protocol_(acqDevice_)
+		, serverStatistics_(serverStatistics)
+		, sessionId_()
+		, lastBytesReceived_()
+		, lastBytesSent_()
+		, ioUringEvent_(ioContext)
+		, ioUringPollTimer_(ioContext)
+		, writeIovecIndex_()
+		, writeMsg_()
+		, zeroCopySendThreshold_(config.zeroCopySendThreshold)
+		, zeroCopyWrite_()
+		, zeroCopyNotifications_()
+		, ioUringWaiting_()
+		, ioUringEventFailed_()
+		, ioUringReaping_()
+		, reading_()
+		, writing_()
+		, waiting_()
+		, streamTimerActive_()
+		, streamFrameDue_()
+		, closed_()
+{
+	protocol_.setRawBufferPool(&rawBufferPool);
+	protocol_.setMemoryBudget(config.sessionMemoryBudget);
+	protocol_.setMaxRequestDataSize(config.maxRequestDataSize);
+
+	// The other threads of the pool may help to compress the signal. The
+	// helper tasks keep the session alive, and the helper that encodes the
+	// last block resumes the session in its strand.
+	if (config.numThreads > 1) {
+		protocol_.setCompressionExecutor(
+			[this, &ioContext](std::function<void()> task) {
+				boost::asio::post(ioContext, [self = this->shared_from_this(), task = std::move(task)]() { task(); });
+			},
+			config.numThreads - 1,
+			[this]() {
+				boost::asio::post(strand_, boost::bind(&ArrayAcqServerSession<AcqDevice>::handleCompression,
+									this->shared_from_this()));
+			});
+	}
+
+	if (config.ioBackend == ServerConfiguration::IO_BACKEND_IO_URING) {
+		try {
+			ioUring_ = std::make_unique<IoUring>(IO_URING_NUM_ENTRIES);
+			const int eventFd = dup(ioUring_->eventFd());
+			if (eventFd == -1) {
+				THROW_EXCEPTION(IoUringException, "Could not duplicate the io_uring event: " << strerror(errno));
+			}
+			boost::system::error_code ec;
+			ioUringEvent_.assign(eventFd, ec);
+			if (ec) {
+				::close(eventFd);
+				THROW_EXCEPTION(IoUringException, "Could not register the io_uring event: " << ec.message());
+			}
+			const boost::asio::mutable_buffer inputStorage = protocol_.inputStorage();
+			if (!ioUring_->registerBuffer(inputStorage.data(), inputStorage.size())) {
+				LOG_WARNING << "Could not register the io_uring input buffer.";
+			}
+		} catch (std::exception& e) {
+			LOG_ERROR << "io_uring disabled in this session: " << e.what();
+			ioUring_.reset();
+		}
+	}
+}
+
+/*******************************************************************************
+ * Starts serving the connected socket.
+ */
+template<typename AcqDevice>
+void
+ArrayAcqServerSession<AcqDevice>::start()
+{
+	LOG_DEBUG << "Session started.";
+
+	boost::system::error_code ec;
+	const boost::asio::ip::tcp::endpoint remoteEndpoint = socket_.remote_endpoint(ec);
+	const boost::asio::ip::address remoteAddress = remoteEndpoint.address();
+	if (!ec) {
+		const boost::asio::ip::address localAddress = socket_.local_endpoint(ec).address();
+		if (!ec) protocol_.setLocalClient(remoteAddress.is_loopback() || remoteAddress == localAddress);
+	}
+
+	std::ostringstream clientName;
+	clientName << remoteEndpoint;
+	sessionId_ = serverStatistics_.addSession(clientName.str());
+	protocol_.setServerStatistics(&serverStatistics_, [this]() { publishStatistics(Clock::now()); });
+	lastStatisticsTime_ = Clock::now();
+
+	startStatisticsTimer();
+
+	boost::asio::post(strand_, boost::bind(&ArrayAcqServerSession<AcqDevice>::process, this->shared_from_this()));
+}
+
+/*******************************************************************************
+ * Closes the connection, interrupting any pending operation.
+ *
+ * May be called from another thread.
+ */
+template<typename AcqDevice>
+void
+ArrayAcqServerSession<AcqDevice>::stop()
+{
+	boost::asio::post(strand_, boost::bind(&ArrayAcqServerSession<AcqDevice>::close, this->shared_from_this()));
+}
+
+/*******************************************************************************
+ * Processes the received messages and starts the next operations.
+ */
+template<typename AcqDevice>
+void
+ArrayAcqServerSession<AcqDevice>::process()
+{
+	if (closed_) return;
+
+	if (!waiting_) {
+		try {
+			protocol_.processMessages();
+		} catch (std::exception& e) {
+			LOG_ERROR << "Session error [" << typeid(e).name() << "]: " << e.what();
+			close();
+			return;
+		}
+
+		const typename Clock::duration delay = protocol_.takeDelay();
+		if (delay > Clock::duration::zero()) {
+			waiting_ = true;
+			delayTimer_.expires_after(delay);
+			delayTimer_.async_wait(boost::asio::bind_executor(strand_,
+					boost::bind(&ArrayAcqServerSession<AcqDevice>::handleDelay, this->shared_from_this(),
+							boost::asio::placeholders::error)));
+		}
+	}
+
+	if (protocol_.streaming() && !protocol_.disconnectRequested()) {
+		if (!streamTimerActive_ && !streamFrameDue_) {
+			// First frame.
+			nextStreamFrameTime_ = Clock::now();
+			streamFrameDue_ = true;
+		}
+		// The frame is only generated when the previous ones have been sent.
+		if (streamFrameDue_ && !waiting_ && !protocol_.compressing() && protocol_.outputQueueSize() == 0) {
+			streamFrameDue_ = false;
+			protocol_.sendStreamSignal();
+			startStreamTimer();
+		}
+	} else {
+		streamFrameDue_ = false;
+	}
+
+	startWrite();
+
+	if (protocol_.disconnectRequested()) {
+		if (!writing_ && !waiting_) {
+			LOG_DEBUG << "Session finished.";
+			close();
+		}
+	} else if (!waiting_ && protocol_.needsInput()) {
+		startRead();
+	}
+
+	submitIoUring();
+}
+
+template<typename AcqDevice>
+void
+ArrayAcqServerSession<AcqDevice>::startRead()
+{
+	if (reading_ || closed_) return;
+	reading_ = true;
+	if (ioUring_) {
+		const boost::asio::mutable_buffer buffer = protocol_.inputBuffer();
+		ioUring_->prepareReceive(socket_.native_handle(), buffer.data(), buffer.size(), IO_URING_READ);
+		return;
+	}
+	socket_.async_read_some(protocol_.inputBuffer(), boost::asio::bind_executor(strand_,
+			boost::bind(&ArrayAcqServerSession<AcqDevice>::handleRead, this->shared_from_this(),
+					boost::asio::placeholders::error, boost::asio::placeholders::bytes_transferred)));
+}
+
+template<typename AcqDevice>
+void
+ArrayAcqServerSession<AcqDevice>::startWrite()
+{
+	if (writing_ || waiting_ || closed_ || !protocol_.outputPending()) return;
+	protocol_.getOutputBuffers(writeBuffers_);
+	writing_ = true;
+	if (ioUring_) {
+		std::size_t writeSize = 0;
+		writeIovecs_.resize(writeBuffers_.size());
+		for (std::size_t i = 0; i < writeBuffers_.size(); ++i) {
+			writeIovecs_[i].iov_base = const_cast<void*>(writeBuffers_[i].data());
+			writeIovecs_[i].iov_len = writeBuffers_[i].size();
+			writeSize += writeBuffers_[i].size();
+		}
+		writeIovecIndex_ = 0;
+		zeroCopyWrite_ = zeroCopySendThreshold_ > 0 && writeSize >= zeroCopySendThreshold_ &&
+					ioUring_->zeroCopySendSupported();
+		prepareIoUringSend();
+		return;
+	}
+	boost::asio::async_write(socket_, writeBuffers_, boost::asio::bind_executor(strand_,
+			boost::bind(&ArrayAcqServerSession<AcqDevice>::handleWrite, this->shared_from_this(),
+					boost::asio::placeholders::error)));
+}
+
+template<typename AcqDevice>
+void
+ArrayAcqServerSession<AcqDevice>::startStreamTimer()
+{
+	// If the frames are late, do not try to catch up.
+	nextStreamFrameTime_ = std::max(nextStreamFrameTime_ + protocol_.streamFramePeriod(), Clock::now());
+	streamTimerActive_ = true;
+	streamTimer_.expires_at(nextStreamFrameTime_);
+	streamTimer_.async_wait(boost::asio::bind_executor(strand_,
+			boost::bind(&ArrayAcqServerSession<AcqDevice>::handleStreamTimer, this->shared_from_this(),
+					boost::asio::placeholders::error)));
+}
+
+template<typename AcqDevice>
+void
+ArrayAcqServerSession<AcqDevice>::startStatisticsTimer()
+{
+	if (closed_) return;
+	statisticsTimer_.expires_after(std::chrono::milliseconds(STATISTICS_PERIOD_MS));
+	statisticsTimer_.async_wait(boost::asio::bind_executor(strand_,
+			boost::bind(&ArrayAcqServerSession<AcqDevice>::handleStatisticsTimer, this->shared_from_this(),
+					boost::asio::placeholders::error)));
+}
+
+template<typename AcqDevice>
+void
+ArrayAcqServerSession<AcqDevice>::handleRead(const boost::system::error_code& ec, std::size_t size)
+{
+	reading_ = false;
+	if (closed_) return;
+	if (ec) {
+		if (ec == boost::asio::error::eof) {
+			LOG_DEBUG << "Connection closed by the client.";
+		} else {
+			LOG_ERROR << "Session error: " << ec.message();
+		}
+		close();
+		return;
+	}
+
+	protocol_.inputReceived(size);
+	process();
+}
+
+template<typename AcqDevice>
+void
+ArrayAcqServerSession<AcqDevice>::handleWrite(const boost::system::error_code& ec)
+{
+	writing_ = false;
+	if (closed_) return;
+	if (ec) {
+		LOG_ERROR << "Session error: " << ec.message();
+		close();
+		return;
+	}
+
+	protocol_.outputSent();
+	process();
+}
+
+template<typename AcqDevice>
+void
+ArrayAcqServerSession<AcqDevice>::handleDelay(const boost::system::error_code& ec)
+{
+	waiting_ = false;
+	if (closed_ || ec) return;
+
+	process();
+}
+
+template<typename AcqDevice>
+void
+ArrayAcqServerSession<AcqDevice>::handleStreamTimer(const boost::system::error_code& ec)
+{
+	streamTimerActive_ = false;
+	if (closed_ || ec) return;
+
+	if (protocol_.streaming()) streamFrameDue_ = true;
+	process();
+}
+
+template<typename AcqDevice>
+void
+ArrayAcqServerSession<AcqDevice>::handleStatisticsTimer(const boost::system::error_code& ec)
+{
+	if (closed_ || ec) return;
+
+	publishStatistics(Clock::now());
+	startStatisticsTimer();
+}
+
+/*******************************************************************************
+ * The compression helpers have encoded the last block of the signal.
+ */
+template<typename AcqDevice>
+void
+ArrayAcqServerSession<AcqDevice>::handleCompression()
+{
+	if (closed_) return;
+
+	protocol_.finishCompression();
+	process();
+}
+
+/*******************************************************************************
+ * Prepares the send of the remaining part of the gather write.
+ */
+template<typename AcqDevice>
+void
+ArrayAcqServerSession<AcqDevice>::prepareIoUringSend()
+{
+	writeMsg_ = msghdr();
+	writeMsg_.msg_iov = &writeIovecs_[writeIovecIndex_];
+	writeMsg_.msg_iovlen = writeIovecs_.size() - writeIovecIndex_;
+	ioUring_->prepareSend(socket_.native_handle(), &writeMsg_, zeroCopyWrite_, IO_URING_WRITE);
+}
+
+/*******************************************************************************
+ * Submits the prepared io_uring requests, and waits for the completions of
+ * all the pending requests.
+ *
+ * If the submission fails, the session is closed. The requests submitted
+ * before are still pending.
+ */
+template<typename AcqDevice>
+void
+ArrayAcqServerSession<AcqDevice>::submitIoUring()
+{
+	// The completion handlers call process(). The wait is started after all
+	// the completions have been taken, otherwise it could wait for a
+	// completion that has already been taken.
+	if (!ioUring_ || ioUringReaping_) return;
+
+	if (!closed_) {
+		try {
+			ioUring_->submit();
+		} catch (std::exception& e) {
+			LOG_ERROR << "Session error: " << e.what();
+			close();
+		}
+	}
+
+	if (!ioUringWaiting_ && ioUring_->numPending() > 0) {
+		ioUringWaiting_ = true;
+		if (ioUringEventFailed_) {
+			ioUringPollTimer_.expires_after(std::chrono::milliseconds(IO_URING_POLL_PERIOD_MS));
+			ioUringPollTimer_.async_wait(boost::asio::bind_executor(strand_,
+					boost::bind(&ArrayAcqServerSession<AcqDevice>::handleIoUringEvent, this->shared_from_this(),
+							boost::asio::placeholders::error)));
+		} else {
+			ioUringEvent_.async_wait(boost::asio::posix::stream_descriptor::wait_read, boost::asio::bind_executor(strand_,
+					boost::bind(&ArrayAcqServerSession<AcqDevice>::handleIoUringEvent, this->shared_from_this(),
+							boost::asio::placeholders::error)));
+		}
+	}
+}
+
+/*******************************************************************************
+ * After an error in the wait, the session is closed, and the completions
+ * of the pending requests are polled.
+ */
+template<typename AcqDevice>
+void
+ArrayAcqServerSession<AcqDevice>::handleIoUringEvent(const boost::system::error_code& ec)
+{
+	ioUringWaiting_ = false;
+	if (ec) {
+		if (ec != boost::asio::error::operation_aborted) {
+			LOG_ERROR << "Session error: " << ec.message();
+		}
+		ioUringEventFailed_ = true;
+		close();
+	}
+
+	ioUring_->clearEvent();
+	IoUring::Completion completion;
+	ioUringReaping_ = true;
+	while (ioUring_->getCompletion(completion)) {
+		if (completion.userData == IO_URING_READ) {
+			if (completion.result > 0) {
+				handleRead(boost::system::error_code(), completion.result);
+			} else if (completion.result == 0) {
+				handleRead(boost::asio::error::eof, 0);
+			} else {
+				handleRead(boost::system::error_code(-completion.result, boost::system::system_category()), 0);
+			}
+		} else {
+			handleIoUringWrite(completion);
+		}
+	}
+	ioUringReaping_ = false;
+
+	submitIoUring();
+}
+
+/*******************************************************************************
+ * The write is complete when all the bytes have been sent, and the
+ * kernel has released the buffers of the zero-copy sends.
+ */
+template<typename AcqDevice>
+void
+ArrayAcqServerSession<AcqDevice>::handleIoUringWrite(const IoUring::Completion& completion)
+{
+#ifdef IORING_CQE_F_NOTIF
+	if (completion.flags & IORING_CQE_F_NOTIF) {
+		--zeroCopyNotifications_;
+		if (writing_ && writeIovecIndex_ == writeIovecs_.size() && zeroCopyNotifications_ == 0) {
+			handleWrite(boost::system::error_code());
+		}
+		return;
+	}
+	if (completion.flags & IORING_CQE_F_MORE) ++zeroCopyNotifications_;
+#endif
+	if (completion.result < 0) {
+		handleWrite(boost::system::error_code(-completion.result, boost::system::system_category()));
+		return;
+	}
+
+	std::size_t sentSize = completion.result;
+	while (sentSize > 0 && writeIovecIndex_ < writeIovecs_.size()) {
+		iovec& iov = writeIovecs_[writeIovecIndex_];
+		if (sentSize >= iov.iov_len) {
+			sentSize -= iov.iov_len;
+			++writeIovecIndex_;
+		} else {
+			iov.iov_base = static_cast<boost::uint8_t*>(iov.iov_base) + sentSize;
+			iov.iov_len -= sentSize;
+			sentSize = 0;
+		}
+	}
+	if (writeIovecIndex_ < writeIovecs_.size()) {
+		if (!closed_) {
+			prepareIoUringSend(); // partial send
+		} else {
+			writing_ = false;
+		}
+		return;
+	}
+	if (zeroCopyNotifications_ == 0) {
+		handleWrite(boost::system::error_code());
+	}
+}
+
+/*******************************************************************************
+ * The pending operations complete with operation_aborted.
+ *
+ * The pending io_uring requests complete when the socket is shut down.
+ */
+template<typename AcqDevice>
+void
+ArrayAcqServerSession<AcqDevice>::close()
+{
+	if (closed_) return;
+	closed_ = true;
+
+	delayTimer_.cancel();
+	streamTimer_.cancel();
+	statisticsTimer_.cancel();
+	boost::system::error_code ec;
+	socket_.shutdown(boost::asio::ip::tcp::socket::shutdown_both, ec);
+	socket_.close(ec);
+
+	if (sessionId_ != 0) {
+		publishStatistics(Clock::now());
+		serverStatistics_.removeSession(sessionId_);
+	}
+}
+
+template<typename AcqDevice>
+void
+ArrayAcqServerSession<AcqDevice>::publishStatistics(typename Clock::time_point now)
+{
+	ServerStatistics::SessionCounters counters;
+	counters.bytesReceived = protocol_.bytesReceived();
+	counters.bytesSent = protocol_.bytesSent();
+	counters.framesSent = protocol_.framesSent();
+	counters.signalTime = protocol_.signalTime();
+	counters.bufferCapacity = protocol_.bufferCapacity();
+	const double period = std::chrono::duration<double>(now - lastStatisticsTime_).count();
+	if (period > 0.0) {
+		counters.receiveRate = (counters.bytesReceived - lastBytesReceived_) / period;
+		counters.sendRate = (counters.bytesSent - lastBytesSent_) / period;
+	}
+	serverStatistics_.updateSession(sessionId_, counters, protocol_.statistics());
+	protocol_.resetStatistics();
+
+	lastStatisticsTime_ = now;
+	lastBytesReceived_ = counters.bytesReceived;
+	lastBytesSent_ = counters.bytesSent;
+}
+
+} // namespace Lab
+
+#endif /* ARRAYACQSERVERSESSION_H_ */
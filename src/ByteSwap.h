@@ -0,0 +1,154 @@
+/*
+
+  Copyright (c) 2013, 2017, 2018, 2019 Marcelo Y. Matuda.
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice,
+       this list of conditions and the following disclaimer.
+    2. Redistributions in binary form must reproduce the above copyright
+       notice, this list of conditions and the following disclaimer in the
+       documentation and/or other materials provided with the distribution.
+    3. Neither the name of the copyright holder nor the names of its
+       contributors may be used to endorse or promote products derived from
+       this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+  OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+  WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+  OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+  ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#ifndef BYTESWAP_H_
+#define BYTESWAP_H_
+
+#include <cstddef> /* std::size_t */
+#include <cstring>
+
+#include <boost/cstdint.hpp>
+
+#if defined(__AVX512BW__) || defined(__AVX2__) || defined(__SSSE3__)
+# include <immintrin.h>
+#elif defined(__SSE2__)
+# include <emmintrin.h>
+#endif
+
+
+
+namespace Lab {
+
+/*******************************************************************************
+ * Copies arrays of 16-bit or 32-bit elements, reversing the bytes of each
+ * element (big-endian <-> little-endian).
+ *
+ * The widest byte shuffle enabled at compile time is used (AVX-512BW, AVX2,
+ * SSSE3, or shifts with SSE2), followed by a scalar loop for the remaining
+ * elements. src and dest need no alignment, but must not overlap.
+ */
+namespace ByteSwap {
+
+void copySwap16(const void* src, std::size_t n, void* dest);
+void copySwap32(const void* src, std::size_t n, void* dest);
+
+
+
+inline
+void
+copySwap16(const void* src, std::size_t n, void* dest)
+{
+	const boost::uint8_t* s = static_cast<const boost::uint8_t*>(src);
+	boost::uint8_t* d = static_cast<boost::uint8_t*>(dest);
+	std::size_t i = 0;
+#if defined(__AVX512BW__)
+	const __m512i mask512 = _mm512_set4_epi32(0x0E0F0C0D, 0x0A0B0809, 0x06070405, 0x02030001);
+	for ( ; i + 32 <= n; i += 32) {
+		const __m512i x = _mm512_loadu_si512(s + i * 2);
+		_mm512_storeu_si512(d + i * 2, _mm512_shuffle_epi8(x, mask512));
+	}
+#endif
+#if defined(__AVX2__)
+	const __m256i mask256 = _mm256_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14,
+						1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+	for ( ; i + 16 <= n; i += 16) {
+		const __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(s + i * 2));
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(d + i * 2), _mm256_shuffle_epi8(x, mask256));
+	}
+#endif
+#if defined(__SSSE3__)
+	const __m128i mask128 = _mm_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+	for ( ; i + 8 <= n; i += 8) {
+		const __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i * 2));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(d + i * 2), _mm_shuffle_epi8(x, mask128));
+	}
+#elif defined(__SSE2__)
+	for ( ; i + 8 <= n; i += 8) {
+		const __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i * 2));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(d + i * 2), _mm_or_si128(_mm_slli_epi16(x, 8), _mm_srli_epi16(x, 8)));
+	}
+#endif
+	for ( ; i < n; ++i) {
+		boost::uint16_t x;
+		std::memcpy(&x, s + i * 2, sizeof(x));
+		x = __builtin_bswap16(x);
+		std::memcpy(d + i * 2, &x, sizeof(x));
+	}
+}
+
+inline
+void
+copySwap32(const void* src, std::size_t n, void* dest)
+{
+	const boost::uint8_t* s = static_cast<const boost::uint8_t*>(src);
+	boost::uint8_t* d = static_cast<boost::uint8_t*>(dest);
+	std::size_t i = 0;
+#if defined(__AVX512BW__)
+	const __m512i mask512 = _mm512_set4_epi32(0x0C0D0E0F, 0x08090A0B, 0x04050607, 0x00010203);
+	for ( ; i + 16 <= n; i += 16) {
+		const __m512i x = _mm512_loadu_si512(s + i * 4);
+		_mm512_storeu_si512(d + i * 4, _mm512_shuffle_epi8(x, mask512));
+	}
+#endif
+#if defined(__AVX2__)
+	const __m256i mask256 = _mm256_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+						3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+	for ( ; i + 8 <= n; i += 8) {
+		const __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(s + i * 4));
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(d + i * 4), _mm256_shuffle_epi8(x, mask256));
+	}
+#endif
+#if defined(__SSSE3__)
+	const __m128i mask128 = _mm_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+	for ( ; i + 4 <= n; i += 4) {
+		const __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i * 4));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(d + i * 4), _mm_shuffle_epi8(x, mask128));
+	}
+#elif defined(__SSE2__)
+	for ( ; i + 4 <= n; i += 4) {
+		// Swap the 16-bit halves, then the bytes of each half.
+		__m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i * 4));
+		x = _mm_shufflehi_epi16(_mm_shufflelo_epi16(x, 0xB1), 0xB1);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(d + i * 4), _mm_or_si128(_mm_slli_epi16(x, 8), _mm_srli_epi16(x, 8)));
+	}
+#endif
+	for ( ; i < n; ++i) {
+		boost::uint32_t x;
+		std::memcpy(&x, s + i * 4, sizeof(x));
+		x = __builtin_bswap32(x);
+		std::memcpy(d + i * 4, &x, sizeof(x));
+	}
+}
+
+} // namespace ByteSwap
+} // namespace Lab
+
+#endif /* BYTESWAP_H_ */
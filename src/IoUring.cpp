@@ -0,0 +1,317 @@
+/*
+
+  Copyright (c) 2013, 2017, 2018, 2019 Marcelo Y. Matuda.
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice,
+       this list of conditions and the following disclaimer.
+    2. Redistributions in binary form must reproduce the above copyright
+       notice, this list of conditions and the following disclaimer in the
+       documentation and/or other materials provided with the distribution.
+    3. Neither the name of the copyright holder nor the names of its
+       contributors may be used to endorse or promote products derived from
+       this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+  OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+  WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+  OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+  ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "IoUring.h"
+
+#include <algorithm> /* max */
+#include <cstring> /* memset, strerror */
+#include <vector>
+
+#include <errno.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h> /* iovec */
+#include <unistd.h>
+
+#define PROBE_NUM_OPS 256
+
+
+
+namespace Lab {
+
+namespace {
+
+int
+ioUringSetup(unsigned int numEntries, io_uring_params* params)
+{
+	return static_cast<int>(syscall(__NR_io_uring_setup, numEntries, params));
+}
+
+int
+ioUringEnter(int fd, unsigned int toSubmit, unsigned int minComplete, unsigned int flags)
+{
+	return static_cast<int>(syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, nullptr, 0));
+}
+
+int
+ioUringRegister(int fd, unsigned int opcode, const void* arg, unsigned int numArgs)
+{
+	return static_cast<int>(syscall(__NR_io_uring_register, fd, opcode, arg, numArgs));
+}
+
+bool
+opSupported(const io_uring_probe* probe, unsigned int op)
+{
+	return op <= probe->last_op && (probe->ops[op].flags & IO_URING_OP_SUPPORTED);
+}
+
+}
+
+IoUring::IoUring(unsigned int numEntries)
+		: ringFd_(-1)
+		, eventFd_(-1)
+		, ring_(MAP_FAILED)
+		, ringSize_()
+		, sqes_(static_cast<io_uring_sqe*>(MAP_FAILED))
+		, sqesSize_()
+		, sqHead_()
+		, sqTail_()
+		, sqMask_()
+		, sqEntries_()
+		, sqLocalTail_()
+		, cqHead_()
+		, cqTail_()
+		, cqMask_()
+		, cqes_()
+		, registeredBuffer_()
+		, registeredBufferSize_()
+		, zeroCopySendSupported_()
+		, numPending_()
+{
+	io_uring_params params;
+	std::memset(&params, 0, sizeof(params));
+	ringFd_ = ioUringSetup(numEntries, &params);
+	if (ringFd_ < 0) {
+		THROW_EXCEPTION(IoUringException, "Could not create the io_uring instance: " << strerror(errno));
+	}
+	if (!(params.features & IORING_FEAT_SINGLE_MMAP)) {
+		release();
+		THROW_EXCEPTION(IoUringException, "The io_uring instance does not support single mmap (Linux < 5.4).");
+	}
+
+	const std::size_t sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+	const std::size_t cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+	ringSize_ = std::max(sqRingSize, cqRingSize);
+	ring_ = mmap(nullptr, ringSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd_, IORING_OFF_SQ_RING);
+	if (ring_ == MAP_FAILED) {
+		const int error = errno;
+		release();
+		THROW_EXCEPTION(IoUringException, "Could not map the io_uring rings: " << strerror(error));
+	}
+	sqesSize_ = params.sq_entries * sizeof(io_uring_sqe);
+	sqes_ = static_cast<io_uring_sqe*>(mmap(nullptr, sqesSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+						ringFd_, IORING_OFF_SQES));
+	if (sqes_ == MAP_FAILED) {
+		const int error = errno;
+		release();
+		THROW_EXCEPTION(IoUringException, "Could not map the io_uring submission entries: " << strerror(error));
+	}
+
+	boost::uint8_t* ring = static_cast<boost::uint8_t*>(ring_);
+	sqHead_    = reinterpret_cast<unsigned int*>(ring + params.sq_off.head);
+	sqTail_    = reinterpret_cast<unsigned int*>(ring + params.sq_off.tail);
+	sqMask_    = *reinterpret_cast<unsigned int*>(ring + params.sq_off.ring_mask);
+	sqEntries_ = *reinterpret_cast<unsigned int*>(ring + params.sq_off.ring_entries);
+	cqHead_    = reinterpret_cast<unsigned int*>(ring + params.cq_off.head);
+	cqTail_    = reinterpret_cast<unsigned int*>(ring + params.cq_off.tail);
+	cqMask_    = *reinterpret_cast<unsigned int*>(ring + params.cq_off.ring_mask);
+	cqes_      = reinterpret_cast<io_uring_cqe*>(ring + params.cq_off.cqes);
+	sqLocalTail_ = *sqTail_;
+
+	// The submission queue entry i is always in the slot i of the array.
+	unsigned int* sqArray = reinterpret_cast<unsigned int*>(ring + params.sq_off.array);
+	for (unsigned int i = 0; i < sqEntries_; ++i) {
+		sqArray[i] = i;
+	}
+
+	std::vector<boost::uint8_t> probeBuffer(sizeof(io_uring_probe) + PROBE_NUM_OPS * sizeof(io_uring_probe_op));
+	io_uring_probe* probe = reinterpret_cast<io_uring_probe*>(probeBuffer.data());
+	if (ioUringRegister(ringFd_, IORING_REGISTER_PROBE, probe, PROBE_NUM_OPS) < 0 ||
+			!opSupported(probe, IORING_OP_RECV) ||
+			!opSupported(probe, IORING_OP_READ_FIXED) ||
+			!opSupported(probe, IORING_OP_SENDMSG)) {
+		release();
+		THROW_EXCEPTION(IoUringException, "The io_uring instance does not support the socket operations (Linux < 5.6).");
+	}
+#ifdef IORING_CQE_F_NOTIF
+	zeroCopySendSupported_ = opSupported(probe, IORING_OP_SENDMSG_ZC);
+#endif
+
+	eventFd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (eventFd_ < 0) {
+		const int error = errno;
+		release();
+		THROW_EXCEPTION(IoUringException, "Could not create the io_uring event: " << strerror(error));
+	}
+	if (ioUringRegister(ringFd_, IORING_REGISTER_EVENTFD, &eventFd_, 1) < 0) {
+		const int error = errno;
+		release();
+		THROW_EXCEPTION(IoUringException, "Could not register the io_uring event: " << strerror(error));
+	}
+}
+
+IoUring::~IoUring()
+{
+	release();
+}
+
+void
+IoUring::release()
+{
+	// Closing the ring cancels the pending requests.
+	if (sqes_ != MAP_FAILED) munmap(sqes_, sqesSize_);
+	if (ring_ != MAP_FAILED) munmap(ring_, ringSize_);
+	if (ringFd_ >= 0) close(ringFd_);
+	if (eventFd_ >= 0) close(eventFd_);
+	sqes_ = static_cast<io_uring_sqe*>(MAP_FAILED);
+	ring_ = MAP_FAILED;
+	ringFd_ = -1;
+	eventFd_ = -1;
+}
+
+bool
+IoUring::isAvailable()
+{
+	try {
+		IoUring ioUring(1);
+	} catch (...) {
+		return false;
+	}
+	return true;
+}
+
+bool
+IoUring::registerBuffer(void* buffer, std::size_t size)
+{
+	iovec iov;
+	iov.iov_base = buffer;
+	iov.iov_len = size;
+	if (ioUringRegister(ringFd_, IORING_REGISTER_BUFFERS, &iov, 1) < 0) {
+		return false;
+	}
+	registeredBuffer_ = static_cast<const boost::uint8_t*>(buffer);
+	registeredBufferSize_ = size;
+	return true;
+}
+
+io_uring_sqe*
+IoUring::getSqe()
+{
+	if (sqLocalTail_ - __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE) >= sqEntries_) {
+		submit();
+		if (sqLocalTail_ - __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE) >= sqEntries_) {
+			THROW_EXCEPTION(IoUringException, "The io_uring submission queue is full.");
+		}
+	}
+	io_uring_sqe* sqe = &sqes_[sqLocalTail_ & sqMask_];
+	std::memset(sqe, 0, sizeof(io_uring_sqe));
+	++sqLocalTail_;
+	return sqe;
+}
+
+void
+IoUring::prepareReceive(int fd, void* buffer, std::size_t size, boost::uint64_t userData)
+{
+	io_uring_sqe* sqe = getSqe();
+	const boost::uint8_t* p = static_cast<const boost::uint8_t*>(buffer);
+	if (registeredBuffer_ && p >= registeredBuffer_ && p + size <= registeredBuffer_ + registeredBufferSize_) {
+		sqe->opcode = IORING_OP_READ_FIXED;
+		sqe->buf_index = 0;
+	} else {
+		sqe->opcode = IORING_OP_RECV;
+	}
+	sqe->fd = fd;
+	sqe->addr = reinterpret_cast<boost::uint64_t>(buffer);
+	sqe->len = static_cast<boost::uint32_t>(size);
+	sqe->user_data = userData;
+}
+
+void
+IoUring::prepareSend(int fd, const msghdr* msg, bool zeroCopy, boost::uint64_t userData)
+{
+	io_uring_sqe* sqe = getSqe();
+#ifdef IORING_CQE_F_NOTIF
+	sqe->opcode = (zeroCopy && zeroCopySendSupported_) ? IORING_OP_SENDMSG_ZC : IORING_OP_SENDMSG;
+#else
+	(void) zeroCopy;
+	sqe->opcode = IORING_OP_SENDMSG;
+#endif
+	sqe->fd = fd;
+	sqe->addr = reinterpret_cast<boost::uint64_t>(msg);
+	sqe->len = 1;
+	sqe->msg_flags = MSG_NOSIGNAL;
+	sqe->user_data = userData;
+}
+
+/*******************************************************************************
+ * Submits all the prepared requests with one system call.
+ */
+void
+IoUring::submit()
+{
+	__atomic_store_n(sqTail_, sqLocalTail_, __ATOMIC_RELEASE);
+	// Includes the requests left by a previous partial submission.
+	const unsigned int toSubmit = sqLocalTail_ - __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE);
+	if (toSubmit == 0) return;
+	for (;;) {
+		const int numSubmitted = ioUringEnter(ringFd_, toSubmit, 0, 0);
+		if (numSubmitted >= 0) {
+			numPending_ += numSubmitted;
+			break;
+		}
+		if (errno != EINTR) {
+			const int error = errno;
+			// The kernel only takes the entries in io_uring_enter.
+			sqLocalTail_ = __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE);
+			__atomic_store_n(sqTail_, sqLocalTail_, __ATOMIC_RELEASE);
+			THROW_EXCEPTION(IoUringException, "Could not submit the io_uring requests: " << strerror(error));
+		}
+	}
+}
+
+bool
+IoUring::getCompletion(Completion& completion)
+{
+	const unsigned int head = *cqHead_;
+	if (head == __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE)) return false;
+
+	const io_uring_cqe& cqe = cqes_[head & cqMask_];
+	completion.userData = cqe.user_data;
+	completion.result = cqe.res;
+	completion.flags = cqe.flags;
+	__atomic_store_n(cqHead_, head + 1, __ATOMIC_RELEASE);
+#ifdef IORING_CQE_F_MORE
+	if (!(completion.flags & IORING_CQE_F_MORE)) --numPending_;
+#else
+	--numPending_;
+#endif
+	return true;
+}
+
+void
+IoUring::clearEvent()
+{
+	eventfd_t value;
+	eventfd_read(eventFd_, &value); // may fail with EAGAIN
+}
+
+} // namespace Lab
@@ -0,0 +1,126 @@
+/*
+
+  Copyright (c) 2013, 2017, 2018, 2019 Marcelo Y. Matuda.
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice,
+       this list of conditions and the following disclaimer.
+    2. Redistributions in binary form must reproduce the above copyright
+       notice, this list of conditions and the following disclaimer in the
+       documentation and/or other materials provided with the distribution.
+    3. Neither the name of the copyright holder nor the names of its
+       contributors may be used to endorse or promote products derived from
+       this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+  OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+  WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+  OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+  ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#ifndef IOURING_H_
+#define IOURING_H_
+
+#include <cstddef> /* std::size_t */
+
+#include <boost/cstdint.hpp>
+
+#include <linux/io_uring.h>
+#include <sys/socket.h> /* msghdr */
+
+#include "Exception.h"
+
+
+
+namespace Lab {
+
+struct IoUringException : public virtual Exception {};
+
+/*******************************************************************************
+ * Minimal io_uring instance, used through the system calls (no liburing).
+ *
+ * The requests are prepared with prepare*() and submitted together with
+ * submit(). The completions are signaled through eventFd(), which can be
+ * watched by the asio reactor, and are taken with getCompletion().
+ *
+ * One buffer may be registered. The reads to this buffer use the
+ * registered (fixed) buffer, avoiding the page pinning per request.
+ *
+ * Not thread-safe.
+ */
+class IoUring {
+public:
+	struct Completion {
+		boost::uint64_t userData;
+		boost::int32_t result; // >= 0: number of bytes, < 0: -errno
+		boost::uint32_t flags;
+	};
+
+	explicit IoUring(unsigned int numEntries);
+	~IoUring();
+
+	// Returns true if an instance can be created in this system.
+	static bool isAvailable();
+
+	int eventFd() const { return eventFd_; }
+	bool zeroCopySendSupported() const { return zeroCopySendSupported_; }
+
+	// Returns false if the buffer could not be registered (e.g. RLIMIT_MEMLOCK).
+	bool registerBuffer(void* buffer, std::size_t size);
+
+	void prepareReceive(int fd, void* buffer, std::size_t size, boost::uint64_t userData);
+	// msg must stay valid until the completion.
+	// With zeroCopy, the buffers must stay valid until the notification
+	// (a completion with IORING_CQE_F_NOTIF set). The first completion
+	// has IORING_CQE_F_MORE set if a notification will follow.
+	void prepareSend(int fd, const msghdr* msg, bool zeroCopy, boost::uint64_t userData);
+	// On error, the prepared requests that were not submitted are discarded.
+	void submit();
+	// Returns false if there is no completion.
+	bool getCompletion(Completion& completion);
+	// Number of submitted requests whose last completion has not been taken.
+	unsigned int numPending() const { return numPending_; }
+	// Resets the event counter.
+	void clearEvent();
+private:
+	IoUring(const IoUring&) = delete;
+	IoUring& operator=(const IoUring&) = delete;
+
+	io_uring_sqe* getSqe();
+	void release();
+
+	int ringFd_;
+	int eventFd_;
+	void* ring_;
+	std::size_t ringSize_;
+	io_uring_sqe* sqes_;
+	std::size_t sqesSize_;
+	unsigned int* sqHead_;
+	unsigned int* sqTail_;
+	unsigned int sqMask_;
+	unsigned int sqEntries_;
+	unsigned int sqLocalTail_;
+	unsigned int* cqHead_;
+	unsigned int* cqTail_;
+	unsigned int cqMask_;
+	io_uring_cqe* cqes_;
+	const boost::uint8_t* registeredBuffer_;
+	std::size_t registeredBufferSize_;
+	bool zeroCopySendSupported_;
+	unsigned int numPending_;
+};
+
+} // namespace Lab
+
+#endif /* IOURING_H_ */
@@ -0,0 +1,161 @@
+/*
+
+  Copyright (c) 2013, 2017, 2018, 2019 Marcelo Y. Matuda.
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice,
+       this list of conditions and the following disclaimer.
+    2. Redistributions in binary form must reproduce the above copyright
+       notice, this list of conditions and the following disclaimer in the
+       documentation and/or other materials provided with the distribution.
+    3. Neither the name of the copyright holder nor the names of its
+       contributors may be used to endorse or promote products derived from
+       this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+  OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+  WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+  OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+  ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#ifndef LATENCYHISTOGRAM_H_
+#define LATENCYHISTOGRAM_H_
+
+#include <algorithm> /* max, min */
+#include <array>
+#include <cmath> /* ceil */
+
+#include <boost/cstdint.hpp>
+
+
+
+namespace Lab {
+
+/*******************************************************************************
+ * Histogram of durations (ns), with log-linear buckets (as in HdrHistogram).
+ *
+ * The values below 2^(SUB_BUCKET_BITS + 1) have their own bucket. Above
+ * that, each power of two is divided in 2^SUB_BUCKET_BITS buckets, so the
+ * relative error of the percentiles is below 2^-SUB_BUCKET_BITS. The values
+ * are clamped to 2^MAX_VALUE_BITS - 1 (about 18 minutes).
+ *
+ * record() is O(1) and does not allocate memory.
+ */
+class LatencyHistogram {
+public:
+	enum {
+		SUB_BUCKET_BITS = 5,
+		MAX_VALUE_BITS = 40,
+		NUM_BUCKETS = (MAX_VALUE_BITS - SUB_BUCKET_BITS + 1) << SUB_BUCKET_BITS
+	};
+
+	LatencyHistogram() : counts_(), count_(), sum_(), max_() {}
+
+	void record(boost::uint64_t value);
+	void add(const LatencyHistogram& other);
+	void reset();
+	boost::uint64_t count() const { return count_; }
+	boost::uint64_t sum() const { return sum_; }
+	boost::uint64_t max() const { return max_; }
+	// p: 0.0 ... 1.0. Returns the middle of the bucket that contains the percentile.
+	boost::uint64_t percentile(double p) const;
+private:
+	static unsigned int bucketIndex(boost::uint64_t value);
+	static boost::uint64_t bucketValue(unsigned int index);
+
+	std::array<boost::uint32_t, NUM_BUCKETS> counts_;
+	boost::uint64_t count_;
+	boost::uint64_t sum_;
+	boost::uint64_t max_;
+};
+
+
+
+inline
+void
+LatencyHistogram::record(boost::uint64_t value)
+{
+	value = std::min<boost::uint64_t>(value, (boost::uint64_t(1) << MAX_VALUE_BITS) - 1);
+	++counts_[bucketIndex(value)];
+	++count_;
+	sum_ += value;
+	max_ = std::max(max_, value);
+}
+
+inline
+void
+LatencyHistogram::add(const LatencyHistogram& other)
+{
+	if (other.count_ == 0) return;
+	for (unsigned int i = 0; i < NUM_BUCKETS; ++i) {
+		counts_[i] += other.counts_[i];
+	}
+	count_ += other.count_;
+	sum_ += other.sum_;
+	max_ = std::max(max_, other.max_);
+}
+
+inline
+void
+LatencyHistogram::reset()
+{
+	if (count_ == 0) return;
+	counts_.fill(0);
+	count_ = 0;
+	sum_ = 0;
+	max_ = 0;
+}
+
+inline
+boost::uint64_t
+LatencyHistogram::percentile(double p) const
+{
+	if (count_ == 0) return 0;
+	const boost::uint64_t rank = std::max<boost::uint64_t>(static_cast<boost::uint64_t>(std::ceil(p * count_)), 1);
+	boost::uint64_t n = 0;
+	for (unsigned int i = 0; i < NUM_BUCKETS; ++i) {
+		n += counts_[i];
+		if (n >= rank) return std::min(bucketValue(i), max_);
+	}
+	return max_;
+}
+
+/*******************************************************************************
+ * value >= 2^SUB_BUCKET_BITS:
+ *     shift = (index of the most significant bit) - SUB_BUCKET_BITS
+ *     index = shift * 2^SUB_BUCKET_BITS + (value >> shift)
+ * (value >> shift) is in [2^SUB_BUCKET_BITS, 2^(SUB_BUCKET_BITS + 1)).
+ */
+inline
+unsigned int
+LatencyHistogram::bucketIndex(boost::uint64_t value)
+{
+	if (value < (1U << SUB_BUCKET_BITS)) return static_cast<unsigned int>(value);
+	const unsigned int shift = (63 - __builtin_clzll(value)) - SUB_BUCKET_BITS;
+	return (shift << SUB_BUCKET_BITS) + static_cast<unsigned int>(value >> shift);
+}
+
+inline
+boost::uint64_t
+LatencyHistogram::bucketValue(unsigned int index)
+{
+	if (index < (2U << SUB_BUCKET_BITS)) return index;
+	const unsigned int shift = (index >> SUB_BUCKET_BITS) - 1;
+	const boost::uint64_t mantissa = index - (shift << SUB_BUCKET_BITS);
+	return (mantissa << shift) + ((boost::uint64_t(1) << shift) >> 1);
+}
+
+} // namespace Lab
+
+#endif /* LATENCYHISTOGRAM_H_ */
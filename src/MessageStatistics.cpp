@@ -0,0 +1,197 @@
+/*
+
+  Copyright (c) 2013, 2017, 2018, 2019 Marcelo Y. Matuda.
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice,
+       this list of conditions and the following disclaimer.
+    2. Redistributions in binary form must reproduce the above copyright
+       notice, this list of conditions and the following disclaimer in the
+       documentation and/or other materials provided with the distribution.
+    3. Neither the name of the copyright holder nor the names of its
+       contributors may be used to endorse or promote products derived from
+       this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+  OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+  WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+  OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+  ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "MessageStatistics.h"
+
+#include <algorithm> /* fill, min */
+#include <iomanip>
+
+
+
+namespace Lab {
+
+MessageStatistics::MessageStatistics(boost::uint32_t firstMessageType, unsigned int numMessageTypes)
+		: firstMessageType_(firstMessageType)
+		, histograms_(numMessageTypes)
+		, allocations_(numMessageTypes)
+{
+}
+
+MessageStatistics::MessageStatistics(const MessageStatistics& o)
+		: firstMessageType_(o.firstMessageType_)
+		, histograms_(o.histograms_.size())
+		, allocations_(o.allocations_.size())
+{
+	add(o);
+}
+
+MessageStatistics&
+MessageStatistics::operator=(const MessageStatistics& o)
+{
+	if (&o != this) {
+		firstMessageType_ = o.firstMessageType_;
+		histograms_.clear();
+		histograms_.resize(o.histograms_.size());
+		allocations_.assign(o.allocations_.size(), 0);
+		add(o);
+	}
+	return *this;
+}
+
+MessageStatistics::~MessageStatistics()
+{
+}
+
+/*******************************************************************************
+ * other must have the same range of message types.
+ */
+void
+MessageStatistics::add(const MessageStatistics& other)
+{
+	const std::size_t n = std::min(histograms_.size(), other.histograms_.size());
+	for (std::size_t i = 0; i < n; ++i) {
+		if (!other.histograms_[i]) continue;
+		if (!histograms_[i]) histograms_[i] = std::make_unique<PhaseHistograms>();
+		for (int phase = 0; phase < NUM_PHASES; ++phase) {
+			(*histograms_[i])[phase].add((*other.histograms_[i])[phase]);
+		}
+	}
+	for (std::size_t i = 0; i < n; ++i) {
+		allocations_[i] += other.allocations_[i];
+	}
+}
+
+/*******************************************************************************
+ * The histograms are kept allocated.
+ */
+void
+MessageStatistics::reset()
+{
+	for (auto& h : histograms_) {
+		if (!h) continue;
+		for (auto& phaseHistogram : *h) {
+			phaseHistogram.reset();
+		}
+	}
+	std::fill(allocations_.begin(), allocations_.end(), 0);
+}
+
+bool
+MessageStatistics::empty() const
+{
+	for (const auto& h : histograms_) {
+		if (!h) continue;
+		for (const auto& phaseHistogram : *h) {
+			if (phaseHistogram.count() > 0) return false;
+		}
+	}
+	return true;
+}
+
+void
+MessageStatistics::print(std::ostream& out, NameFunction messageTypeName) const
+{
+	const std::ios_base::fmtflags flags = out.flags();
+	const std::streamsize precision = out.precision();
+	out << std::fixed << std::setprecision(1);
+	for (std::size_t i = 0; i < histograms_.size(); ++i) {
+		if (!histograms_[i]) continue;
+		for (int phase = 0; phase < NUM_PHASES; ++phase) {
+			const LatencyHistogram& h = (*histograms_[i])[phase];
+			if (h.count() == 0) continue;
+			out << messageTypeName(firstMessageType_ + i) << ' ' << phaseName(phase)
+				<< " count=" << h.count()
+				<< " p50=" << h.percentile(0.5) * 1.0e-3
+				<< " p99=" << h.percentile(0.99) * 1.0e-3
+				<< " p99.9=" << h.percentile(0.999) * 1.0e-3
+				<< " max=" << h.max() * 1.0e-3 << " us\n";
+		}
+		if (allocations_[i] > 0) {
+			out << messageTypeName(firstMessageType_ + i) << " allocations=" << allocations_[i] << '\n';
+		}
+	}
+	out.flags(flags);
+	out.precision(precision);
+}
+
+void
+MessageStatistics::writeMetrics(std::ostream& out, const char* metricName, NameFunction messageTypeName) const
+{
+	const double quantiles[] = { 0.5, 0.99, 0.999 };
+	const std::streamsize precision = out.precision(9);
+	out << "# HELP " << metricName << " Latency of the processing phases of the requests.\n"
+		<< "# TYPE " << metricName << " summary\n";
+	for (std::size_t i = 0; i < histograms_.size(); ++i) {
+		if (!histograms_[i]) continue;
+		for (int phase = 0; phase < NUM_PHASES; ++phase) {
+			const LatencyHistogram& h = (*histograms_[i])[phase];
+			if (h.count() == 0) continue;
+			const char* type = messageTypeName(firstMessageType_ + i);
+			for (double q : quantiles) {
+				out << metricName << "{type=\"" << type << "\",phase=\"" << phaseName(phase)
+					<< "\",quantile=\"" << q << "\"} " << h.percentile(q) * 1.0e-9 << '\n';
+			}
+			out << metricName << "_sum{type=\"" << type << "\",phase=\"" << phaseName(phase)
+				<< "\"} " << h.sum() * 1.0e-9 << '\n';
+			out << metricName << "_count{type=\"" << type << "\",phase=\"" << phaseName(phase)
+				<< "\"} " << h.count() << '\n';
+		}
+	}
+	out.precision(precision);
+}
+
+/*******************************************************************************
+ * Only the message types that have been processed are written.
+ */
+void
+MessageStatistics::writeAllocationMetrics(std::ostream& out, const char* metricName, NameFunction messageTypeName) const
+{
+	out << "# HELP " << metricName << " Heap allocations made while processing the requests.\n"
+		<< "# TYPE " << metricName << " counter\n";
+	for (std::size_t i = 0; i < histograms_.size(); ++i) {
+		if (!histograms_[i]) continue;
+		out << metricName << "{type=\"" << messageTypeName(firstMessageType_ + i) << "\"} " << allocations_[i] << '\n';
+	}
+}
+
+const char*
+MessageStatistics::phaseName(int phase)
+{
+	switch (phase) {
+	case PHASE_RECEIVE:       return "receive";
+	case PHASE_DEVICE:        return "device";
+	case PHASE_SERIALIZATION: return "serialization";
+	case PHASE_SEND:          return "send";
+	default:                  return "?";
+	}
+}
+
+} // namespace Lab
@@ -0,0 +1,126 @@
+/*
+
+  Copyright (c) 2013, 2017, 2018, 2019 Marcelo Y. Matuda.
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice,
+       this list of conditions and the following disclaimer.
+    2. Redistributions in binary form must reproduce the above copyright
+       notice, this list of conditions and the following disclaimer in the
+       documentation and/or other materials provided with the distribution.
+    3. Neither the name of the copyright holder nor the names of its
+       contributors may be used to endorse or promote products derived from
+       this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+  OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+  WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+  OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+  ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#ifndef MESSAGESTATISTICS_H_
+#define MESSAGESTATISTICS_H_
+
+#include <array>
+#include <chrono>
+#include <memory>
+#include <ostream>
+#include <vector>
+
+#include <boost/cstdint.hpp>
+
+#include "LatencyHistogram.h"
+
+
+
+namespace Lab {
+
+/*******************************************************************************
+ * Latency histograms of the processing phases, for each message type.
+ *
+ * The number of heap allocations made while processing each message type
+ * is also counted (see AllocationCounter).
+ *
+ * The histograms of a message type are allocated when its first value is
+ * recorded. Not thread-safe: each session has its own object, which is
+ * merged periodically into ServerStatistics.
+ */
+class MessageStatistics {
+public:
+	typedef std::chrono::steady_clock Clock;
+
+	enum Phase {
+		PHASE_RECEIVE,       // from the reception of the last byte of the request to the start of processing
+		PHASE_DEVICE,        // in the device calls
+		PHASE_SERIALIZATION, // decoding, encoding and the other processing
+		PHASE_SEND,          // from the queuing of the response to the end of its write
+		NUM_PHASES
+	};
+	typedef const char* (*NameFunction)(boost::uint32_t messageType);
+
+	// The valid message types are firstMessageType ... firstMessageType + numMessageTypes - 1.
+	MessageStatistics(boost::uint32_t firstMessageType, unsigned int numMessageTypes);
+	MessageStatistics(const MessageStatistics& o);
+	MessageStatistics& operator=(const MessageStatistics& o);
+	~MessageStatistics();
+
+	// Invalid message types are ignored.
+	void record(boost::uint32_t messageType, Phase phase, Clock::duration duration);
+	void recordAllocations(boost::uint32_t messageType, boost::uint64_t count);
+	void add(const MessageStatistics& other);
+	void reset();
+	bool empty() const;
+	// One line per message type and phase:
+	//     message type, phase, count, p50, p99, p99.9, max (us)
+	void print(std::ostream& out, NameFunction messageTypeName) const;
+	// Prometheus summary, in seconds, with the labels type and phase.
+	void writeMetrics(std::ostream& out, const char* metricName, NameFunction messageTypeName) const;
+	// Prometheus counter of the allocations, with the label type.
+	void writeAllocationMetrics(std::ostream& out, const char* metricName, NameFunction messageTypeName) const;
+private:
+	typedef std::array<LatencyHistogram, NUM_PHASES> PhaseHistograms;
+
+	static const char* phaseName(int phase);
+
+	boost::uint32_t firstMessageType_;
+	std::vector<std::unique_ptr<PhaseHistograms>> histograms_; // null: no values
+	std::vector<boost::uint64_t> allocations_;
+};
+
+
+
+inline
+void
+MessageStatistics::record(boost::uint32_t messageType, Phase phase, Clock::duration duration)
+{
+	const boost::uint32_t index = messageType - firstMessageType_;
+	if (index >= histograms_.size()) return;
+	std::unique_ptr<PhaseHistograms>& h = histograms_[index];
+	if (!h) h = std::make_unique<PhaseHistograms>();
+	const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count();
+	(*h)[phase].record(ns > 0 ? ns : 0);
+}
+
+inline
+void
+MessageStatistics::recordAllocations(boost::uint32_t messageType, boost::uint64_t count)
+{
+	const boost::uint32_t index = messageType - firstMessageType_;
+	if (index >= allocations_.size()) return;
+	allocations_[index] += count;
+}
+
+} // namespace Lab
+
+#endif /* MESSAGESTATISTICS_H_ */
@@ -0,0 +1,347 @@
+/*
+
+  Copyright (c) 2013, 2017, 2018, 2019 Marcelo Y. Matuda.
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice,
+       this list of conditions and the following disclaimer.
+    2. Redistributions in binary form must reproduce the above copyright
+       notice, this list of conditions and the following disclaimer in the
+       documentation and/or other materials provided with the distribution.
+    3. Neither the name of the copyright holder nor the names of its
+       contributors may be used to endorse or promote products derived from
+       this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+  OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+  WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+  OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+  ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#ifndef NOISEGENERATOR_H_
+#define NOISEGENERATOR_H_
+
+#include <algorithm> /* min */
+#include <cstddef> /* std::size_t */
+#include <cstring> /* memcpy */
+
+#include <boost/cstdint.hpp>
+
+#if defined(__AVX512BW__) || defined(__AVX2__)
+# include <immintrin.h>
+#elif defined(__SSE2__)
+# include <emmintrin.h>
+#endif
+
+#include "Exception.h"
+#include "RawBuffer.h"
+
+
+
+namespace Lab {
+
+/*******************************************************************************
+ * Counter-based generator of uniform integer noise (Philox4x32-10).
+ *
+ * The noise of the sample with index i in frame f is a function of
+ * (seed, f, i) only, so any range of samples of any frame can be generated
+ * independently, in any order or in parallel, and always gives the same
+ * values.
+ *
+ * The samples are generated in groups of GROUP_SIZE. The sample j of group g
+ * takes 16 bits of the output word j / 16 of the Philox block with counter
+ * (8 * g + (j % 16) / 2, f), low half if j is even. With this layout each
+ * AVX2 (or SSE2) register of the eight blocks of a group holds 16 (or 8)
+ * consecutive samples, and no transposition is needed. With AVX-512BW, two
+ * groups are generated at a time.
+ *
+ * The uint16 value u is mapped to minValue + (u * (maxValue - minValue + 1)) / 65536.
+ */
+class NoiseGenerator {
+public:
+	enum {
+		GROUP_SIZE = 64 // samples
+	};
+
+	NoiseGenerator(boost::uint64_t seed, boost::int16_t minValue, boost::int16_t maxValue);
+
+	boost::int16_t value(boost::uint64_t frame, boost::uint64_t index) const;
+	// Writes signal[k] + value(frame, firstIndex + k), saturated to int16,
+	// for k in [0, n), in the given byte order. out needs no alignment.
+	void addTo(const boost::int16_t* signal, std::size_t n, boost::uint64_t frame, boost::uint64_t firstIndex,
+			RawBuffer::ByteOrder byteOrder, boost::uint8_t* out) const;
+private:
+	enum {
+		PHILOX_M0 = 0xD2511F53,
+		PHILOX_M1 = 0xCD9E8D57,
+		PHILOX_W0 = 0x9E3779B9,
+		PHILOX_W1 = 0xBB67AE85,
+		PHILOX_ROUNDS = 10
+	};
+
+	// Raw 16-bit values of the group, in sample order.
+	void generateGroup(boost::uint64_t frame, boost::uint64_t group, boost::uint16_t* noise) const;
+	void addToGroups(const boost::int16_t* signal, boost::uint64_t frame, boost::uint64_t firstGroup,
+				std::size_t numGroups, bool swapBytes, boost::uint8_t* out) const;
+	boost::int16_t map(boost::uint16_t u) const { return minValue_ + ((static_cast<boost::uint32_t>(u) * range_) >> 16); }
+	static void store(boost::int32_t value, bool swapBytes, boost::uint8_t* out);
+
+	boost::uint32_t key0_;
+	boost::uint32_t key1_;
+	boost::int16_t minValue_;
+	boost::uint32_t range_;
+};
+
+inline
+NoiseGenerator::NoiseGenerator(boost::uint64_t seed, boost::int16_t minValue, boost::int16_t maxValue)
+		: key0_(static_cast<boost::uint32_t>(seed))
+		, key1_(static_cast<boost::uint32_t>(seed >> 32))
+		, minValue_(minValue)
+		, range_(maxValue - minValue + 1)
+{
+	if (maxValue < minValue || range_ > 65535) {
+		THROW_EXCEPTION(InvalidParameterException, "Invalid noise range: [" << minValue << ", " << maxValue << "].");
+	}
+}
+
+inline
+boost::int16_t
+NoiseGenerator::value(boost::uint64_t frame, boost::uint64_t index) const
+{
+	boost::uint16_t noise[GROUP_SIZE];
+	generateGroup(frame, index / GROUP_SIZE, noise);
+	return map(noise[index % GROUP_SIZE]);
+}
+
+/*******************************************************************************
+ * The complete groups use SIMD. The partial groups at the ends of the range
+ * are generated complete, and only their samples in the range are used.
+ */
+inline
+void
+NoiseGenerator::addTo(const boost::int16_t* signal, std::size_t n, boost::uint64_t frame, boost::uint64_t firstIndex,
+			RawBuffer::ByteOrder byteOrder, boost::uint8_t* out) const
+{
+	const bool swapBytes = !RawBuffer::isNative(byteOrder);
+	boost::uint16_t noise[GROUP_SIZE];
+	for (std::size_t k = 0; k < n; ) {
+		const boost::uint64_t index = firstIndex + k;
+		const boost::uint64_t group = index / GROUP_SIZE;
+		const std::size_t offset = index % GROUP_SIZE;
+		if (offset == 0 && n - k >= GROUP_SIZE) {
+			const std::size_t numGroups = (n - k) / GROUP_SIZE;
+			addToGroups(signal + k, frame, group, numGroups, swapBytes, out + k * sizeof(boost::int16_t));
+			k += numGroups * GROUP_SIZE;
+		} else {
+			const std::size_t count = std::min<std::size_t>(GROUP_SIZE - offset, n - k);
+			generateGroup(frame, group, noise);
+			for (std::size_t j = 0; j < count; ++j) {
+				store(static_cast<boost::int32_t>(signal[k + j]) + map(noise[offset + j]), swapBytes,
+					out + (k + j) * sizeof(boost::int16_t));
+			}
+			k += count;
+		}
+	}
+}
+
+inline
+void
+NoiseGenerator::generateGroup(boost::uint64_t frame, boost::uint64_t group, boost::uint16_t* noise) const
+{
+	for (unsigned int b = 0; b < 8; ++b) {
+		const boost::uint64_t counter = 8 * group + b;
+		boost::uint32_t x[4] = {
+			static_cast<boost::uint32_t>(counter), static_cast<boost::uint32_t>(counter >> 32),
+			static_cast<boost::uint32_t>(frame), static_cast<boost::uint32_t>(frame >> 32)
+		};
+		boost::uint32_t k0 = key0_;
+		boost::uint32_t k1 = key1_;
+		for (unsigned int round = 0; round < PHILOX_ROUNDS; ++round, k0 += PHILOX_W0, k1 += PHILOX_W1) {
+			const boost::uint64_t p0 = static_cast<boost::uint64_t>(PHILOX_M0) * x[0];
+			const boost::uint64_t p1 = static_cast<boost::uint64_t>(PHILOX_M1) * x[2];
+			x[0] = static_cast<boost::uint32_t>(p1 >> 32) ^ x[1] ^ k0;
+			x[1] = static_cast<boost::uint32_t>(p1);
+			x[2] = static_cast<boost::uint32_t>(p0 >> 32) ^ x[3] ^ k1;
+			x[3] = static_cast<boost::uint32_t>(p0);
+		}
+		for (unsigned int w = 0; w < 4; ++w) {
+			noise[16 * w + 2 * b]     = static_cast<boost::uint16_t>(x[w]);
+			noise[16 * w + 2 * b + 1] = static_cast<boost::uint16_t>(x[w] >> 16);
+		}
+	}
+}
+
+inline
+void
+NoiseGenerator::store(boost::int32_t value, bool swapBytes, boost::uint8_t* out)
+{
+	boost::uint16_t x = static_cast<boost::uint16_t>(std::min<boost::int32_t>(std::max<boost::int32_t>(value, -32768), 32767));
+	if (swapBytes) x = __builtin_bswap16(x);
+	std::memcpy(out, &x, sizeof(x));
+}
+
+/*******************************************************************************
+ * The eight Philox blocks of a group are computed in parallel, one block
+ * per 32-bit lane (two sets of four blocks with SSE2, two groups with AVX-512BW).
+ */
+inline
+void
+NoiseGenerator::addToGroups(const boost::int16_t* signal, boost::uint64_t frame, boost::uint64_t firstGroup,
+				std::size_t numGroups, bool swapBytes, boost::uint8_t* out) const
+{
+	std::size_t i = 0;
+#if defined(__AVX512BW__)
+	for ( ; i + 2 <= numGroups; i += 2) {
+		// The counters of the lanes 8 ... 15 may carry into the high word.
+		const boost::uint64_t firstCounter = 8 * (firstGroup + i);
+		const __m512i base = _mm512_set1_epi32(static_cast<boost::uint32_t>(firstCounter));
+		__m512i x0 = _mm512_add_epi32(base, _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15));
+		__m512i x1 = _mm512_set1_epi32(static_cast<boost::uint32_t>(firstCounter >> 32));
+		x1 = _mm512_mask_add_epi32(x1, _mm512_cmplt_epu32_mask(x0, base), x1, _mm512_set1_epi32(1));
+		__m512i x2 = _mm512_set1_epi32(static_cast<boost::uint32_t>(frame));
+		__m512i x3 = _mm512_set1_epi32(static_cast<boost::uint32_t>(frame >> 32));
+		const __m512i m0 = _mm512_set1_epi32(PHILOX_M0);
+		const __m512i m1 = _mm512_set1_epi32(PHILOX_M1);
+		boost::uint32_t k0 = key0_;
+		boost::uint32_t k1 = key1_;
+		for (unsigned int round = 0; round < PHILOX_ROUNDS; ++round, k0 += PHILOX_W0, k1 += PHILOX_W1) {
+			// 32x32->64 products of the even and odd lanes. The zero-masked forms
+			// (all lanes enabled) avoid a false -Wmaybe-uninitialized in GCC 12.
+			const __m512i p0Even = _mm512_maskz_mul_epu32(0xFF, x0, m0);
+			const __m512i p0Odd  = _mm512_maskz_mul_epu32(0xFF, _mm512_maskz_srli_epi64(0xFF, x0, 32), m0);
+			const __m512i p1Even = _mm512_maskz_mul_epu32(0xFF, x2, m1);
+			const __m512i p1Odd  = _mm512_maskz_mul_epu32(0xFF, _mm512_maskz_srli_epi64(0xFF, x2, 32), m1);
+			const __m512i hi0 = _mm512_mask_blend_epi32(0xAAAA, _mm512_maskz_srli_epi64(0xFF, p0Even, 32), p0Odd);
+			const __m512i lo0 = _mm512_mask_blend_epi32(0xAAAA, p0Even, _mm512_maskz_slli_epi64(0xFF, p0Odd, 32));
+			const __m512i hi1 = _mm512_mask_blend_epi32(0xAAAA, _mm512_maskz_srli_epi64(0xFF, p1Even, 32), p1Odd);
+			const __m512i lo1 = _mm512_mask_blend_epi32(0xAAAA, p1Even, _mm512_maskz_slli_epi64(0xFF, p1Odd, 32));
+			x0 = _mm512_xor_si512(_mm512_xor_si512(hi1, x1), _mm512_set1_epi32(k0));
+			x1 = lo1;
+			x2 = _mm512_xor_si512(_mm512_xor_si512(hi0, x3), _mm512_set1_epi32(k1));
+			x3 = lo0;
+		}
+		const __mmask32 LOW_HALF_MASK = 0x0000FFFF;
+		const __mmask32 HIGH_HALF_MASK = 0xFFFF0000;
+		const __m512i range = _mm512_set1_epi16(static_cast<boost::int16_t>(range_));
+		const __m512i minValue = _mm512_set1_epi16(minValue_);
+		const __m512i words[4] = { x0, x1, x2, x3 };
+		const boost::int16_t* groupSignal = signal + i * GROUP_SIZE;
+		boost::uint8_t* groupOut = out + i * GROUP_SIZE * sizeof(boost::int16_t);
+		for (unsigned int w = 0; w < 4; ++w) {
+			// The low half belongs to the first group, the high half to the second.
+			// The masked loads and stores address the high half 16 samples early.
+			const __m512i noise = _mm512_add_epi16(_mm512_mulhi_epu16(words[w], range), minValue);
+			const __m512i x = _mm512_or_si512(
+						_mm512_maskz_loadu_epi16(LOW_HALF_MASK, groupSignal + 16 * w),
+						_mm512_maskz_loadu_epi16(HIGH_HALF_MASK, groupSignal + GROUP_SIZE + 16 * w - 16));
+			__m512i y = _mm512_adds_epi16(x, noise);
+			if (swapBytes) y = _mm512_or_si512(_mm512_slli_epi16(y, 8), _mm512_srli_epi16(y, 8));
+			_mm512_mask_storeu_epi16(groupOut + 32 * w, LOW_HALF_MASK, y);
+			_mm512_mask_storeu_epi16(groupOut + 2 * GROUP_SIZE + 32 * w - 32, HIGH_HALF_MASK, y);
+		}
+	}
+#endif
+	for ( ; i < numGroups; ++i) {
+		const boost::int16_t* groupSignal = signal + i * GROUP_SIZE;
+		boost::uint8_t* groupOut = out + i * GROUP_SIZE * sizeof(boost::int16_t);
+#if defined(__AVX2__) || defined(__SSE2__)
+		const boost::uint64_t firstCounter = 8 * (firstGroup + i); // the lanes add 0 ... 7 without carry
+#endif
+#if defined(__AVX2__)
+		__m256i x0 = _mm256_add_epi32(_mm256_set1_epi32(static_cast<boost::uint32_t>(firstCounter)),
+						_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+		__m256i x1 = _mm256_set1_epi32(static_cast<boost::uint32_t>(firstCounter >> 32));
+		__m256i x2 = _mm256_set1_epi32(static_cast<boost::uint32_t>(frame));
+		__m256i x3 = _mm256_set1_epi32(static_cast<boost::uint32_t>(frame >> 32));
+		const __m256i m0 = _mm256_set1_epi32(PHILOX_M0);
+		const __m256i m1 = _mm256_set1_epi32(PHILOX_M1);
+		boost::uint32_t k0 = key0_;
+		boost::uint32_t k1 = key1_;
+		for (unsigned int round = 0; round < PHILOX_ROUNDS; ++round, k0 += PHILOX_W0, k1 += PHILOX_W1) {
+			// 32x32->64 products of the even and odd lanes.
+			const __m256i p0Even = _mm256_mul_epu32(x0, m0);
+			const __m256i p0Odd  = _mm256_mul_epu32(_mm256_srli_epi64(x0, 32), m0);
+			const __m256i p1Even = _mm256_mul_epu32(x2, m1);
+			const __m256i p1Odd  = _mm256_mul_epu32(_mm256_srli_epi64(x2, 32), m1);
+			const __m256i hi0 = _mm256_blend_epi32(_mm256_srli_epi64(p0Even, 32), p0Odd, 0xAA);
+			const __m256i lo0 = _mm256_blend_epi32(p0Even, _mm256_slli_epi64(p0Odd, 32), 0xAA);
+			const __m256i hi1 = _mm256_blend_epi32(_mm256_srli_epi64(p1Even, 32), p1Odd, 0xAA);
+			const __m256i lo1 = _mm256_blend_epi32(p1Even, _mm256_slli_epi64(p1Odd, 32), 0xAA);
+			x0 = _mm256_xor_si256(_mm256_xor_si256(hi1, x1), _mm256_set1_epi32(k0));
+			x1 = lo1;
+			x2 = _mm256_xor_si256(_mm256_xor_si256(hi0, x3), _mm256_set1_epi32(k1));
+			x3 = lo0;
+		}
+		const __m256i range = _mm256_set1_epi16(static_cast<boost::int16_t>(range_));
+		const __m256i minValue = _mm256_set1_epi16(minValue_);
+		const __m256i words[4] = { x0, x1, x2, x3 };
+		for (unsigned int w = 0; w < 4; ++w) {
+			const __m256i noise = _mm256_add_epi16(_mm256_mulhi_epu16(words[w], range), minValue);
+			const __m256i s = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(groupSignal + 16 * w));
+			__m256i y = _mm256_adds_epi16(s, noise);
+			if (swapBytes) y = _mm256_or_si256(_mm256_slli_epi16(y, 8), _mm256_srli_epi16(y, 8));
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(groupOut + 32 * w), y);
+		}
+#elif defined(__SSE2__)
+		const __m128i m0 = _mm_set1_epi32(PHILOX_M0);
+		const __m128i m1 = _mm_set1_epi32(PHILOX_M1);
+		const __m128i range = _mm_set1_epi16(static_cast<boost::int16_t>(range_));
+		const __m128i minValue = _mm_set1_epi16(minValue_);
+		for (unsigned int half = 0; half < 2; ++half) {
+			__m128i x0 = _mm_add_epi32(_mm_set1_epi32(static_cast<boost::uint32_t>(firstCounter) + 4 * half),
+							_mm_setr_epi32(0, 1, 2, 3));
+			__m128i x1 = _mm_set1_epi32(static_cast<boost::uint32_t>(firstCounter >> 32));
+			__m128i x2 = _mm_set1_epi32(static_cast<boost::uint32_t>(frame));
+			__m128i x3 = _mm_set1_epi32(static_cast<boost::uint32_t>(frame >> 32));
+			boost::uint32_t k0 = key0_;
+			boost::uint32_t k1 = key1_;
+			for (unsigned int round = 0; round < PHILOX_ROUNDS; ++round, k0 += PHILOX_W0, k1 += PHILOX_W1) {
+				// 32x32->64 products of the even and odd lanes, reordered to
+				// (lane 0, lane 2, lane 1, lane 3) halves for the unpacks.
+				const __m128i p0Even = _mm_shuffle_epi32(_mm_mul_epu32(x0, m0), 0xD8);
+				const __m128i p0Odd  = _mm_shuffle_epi32(_mm_mul_epu32(_mm_srli_epi64(x0, 32), m0), 0xD8);
+				const __m128i p1Even = _mm_shuffle_epi32(_mm_mul_epu32(x2, m1), 0xD8);
+				const __m128i p1Odd  = _mm_shuffle_epi32(_mm_mul_epu32(_mm_srli_epi64(x2, 32), m1), 0xD8);
+				const __m128i lo0 = _mm_unpacklo_epi32(p0Even, p0Odd);
+				const __m128i hi0 = _mm_unpackhi_epi32(p0Even, p0Odd);
+				const __m128i lo1 = _mm_unpacklo_epi32(p1Even, p1Odd);
+				const __m128i hi1 = _mm_unpackhi_epi32(p1Even, p1Odd);
+				x0 = _mm_xor_si128(_mm_xor_si128(hi1, x1), _mm_set1_epi32(k0));
+				x1 = lo1;
+				x2 = _mm_xor_si128(_mm_xor_si128(hi0, x3), _mm_set1_epi32(k1));
+				x3 = lo0;
+			}
+			const __m128i words[4] = { x0, x1, x2, x3 };
+			for (unsigned int w = 0; w < 4; ++w) {
+				const std::size_t j = 16 * w + 8 * half; // first sample
+				const __m128i noise = _mm_add_epi16(_mm_mulhi_epu16(words[w], range), minValue);
+				const __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(groupSignal + j));
+				__m128i y = _mm_adds_epi16(s, noise);
+				if (swapBytes) y = _mm_or_si128(_mm_slli_epi16(y, 8), _mm_srli_epi16(y, 8));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(groupOut + 2 * j), y);
+			}
+		}
+#else
+		boost::uint16_t noise[GROUP_SIZE];
+		generateGroup(frame, firstGroup + i, noise);
+		for (std::size_t j = 0; j < GROUP_SIZE; ++j) {
+			store(static_cast<boost::int32_t>(groupSignal[j]) + map(noise[j]), swapBytes, groupOut + j * sizeof(boost::int16_t));
+		}
+#endif
+	}
+}
+
+} // namespace Lab
+
+#endif /* NOISEGENERATOR_H_ */
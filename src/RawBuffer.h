@@ -32,21 +32,36 @@
 #ifndef RAWBUFFER_H_
 #define RAWBUFFER_H_
 
+#include <algorithm> /* std::max */
 #include <cstddef> /* std::size_t */
 #include <cstring>
+#include <limits>
 #include <string>
+#include <type_traits>
+#include <utility> /* swap */
 #include <vector>
 
 #include <boost/cstdint.hpp>
+#include <boost/predef/other/endian.h>
+#include <boost/utility/string_view.hpp>
 
+#include "ByteSwap.h"
 #include "Exception.h"
+#include "RawBufferPool.h"
 
 
 
 namespace Lab {
 
 /*******************************************************************************
+ * The numbers are big-endian, unless the byte order is changed with
+ * setByteOrder(). If the byte order is the native one, the arrays are
+ * copied without conversion.
  *
+ * The storage grows without initializing the new bytes. If a pool is set
+ * with setPool(), a buffer that grows beyond INITIAL_RESERVED_SIZE, up to
+ * the pool block size, takes a block from the pool, and returns it when the
+ * storage is freed. swap() exchanges the storage, but not the pools.
  */
 class RawBuffer {
 public:
@@ -56,14 +71,42 @@ public:
 	enum {
 		INITIAL_RESERVED_SIZE = 8192
 	};
+	enum ByteOrder {
+		BYTE_ORDER_BIG_ENDIAN,
+		BYTE_ORDER_LITTLE_ENDIAN
+	};
 
-	RawBuffer() : readIndex_() {
-		buffer_.reserve(INITIAL_RESERVED_SIZE);
+	RawBuffer()
+		: data_()
+		, size_()
+		, capacity_()
+		, readIndex_()
+		, pool_()
+		, storagePool_()
+		, byteOrder_(BYTE_ORDER_BIG_ENDIAN) {}
+	~RawBuffer() { freeStorage(); }
+
+	// Used by the next allocations. pool must outlive the buffer.
+	void setPool(RawBufferPool* pool) { pool_ = pool; }
+
+	// The byte order is not affected by reset() and swap().
+	void setByteOrder(ByteOrder byteOrder) { byteOrder_ = byteOrder; }
+	ByteOrder byteOrder() const { return byteOrder_; }
+	static bool isNative(ByteOrder byteOrder)
+	{
+#if BOOST_ENDIAN_LITTLE_BYTE
+		return byteOrder == BYTE_ORDER_LITTLE_ENDIAN;
+#else
+		return byteOrder == BYTE_ORDER_BIG_ENDIAN;
+#endif
 	}
-	~RawBuffer() {}
 
 	void reset();
+	// Sets the size, without initializing the new bytes, and rewinds.
 	void reserve(std::size_t size);
+	// Like reset(), but also frees the storage.
+	void clear();
+	void swap(RawBuffer& other);
 
 	void putInt16(boost::int16_t value);
 	boost::int16_t getInt16();
@@ -75,41 +118,119 @@ public:
 	float getFloat();
 
 	void putString(const std::string& s);
+	void putString(const char* s); // null-terminated
+	void putString(const char* s, std::size_t size);
+	// The capacity of s is reused.
 	void getString(std::string& s);
+	// Returns the string without copying it. The view points to the
+	// buffer, and is invalidated by the next put* call or reset().
+	boost::string_view getStringView();
 
 	void putFloatArray(const std::vector<float>& a);
 	void getFloatArray(std::vector<float>& a);
+	// Reads arraySize floats, without the array size.
+	void getFloatArrayElements(float* a, std::size_t arraySize);
 
 	template<typename T> void putInt16Array(const std::vector<T>& a);
 	template<typename T> void putInt16Array(const T* a, std::size_t arraySize);
 	template<typename T> void getInt16Array(std::vector<T>& a);
 	template<typename T> void getInt16Array(T* a, std::size_t arraySize);
+	boost::uint8_t* putInt16ArraySpace(std::size_t arraySize);
+	boost::uint8_t* putSpace(std::size_t size);
+
+	// Loads a big-endian uint32 from p.
+	static boost::uint32_t loadUInt32(const boost::uint8_t* p)
+	{
+		return (static_cast<boost::uint32_t>(p[0]) << 24) |
+			(static_cast<boost::uint32_t>(p[1]) << 16) |
+			(static_cast<boost::uint32_t>(p[2]) << 8) |
+			 static_cast<boost::uint32_t>(p[3]);
+	}
+
+	// Loads a big-endian int16 from p.
+	static boost::int16_t loadInt16(const boost::uint8_t* p)
+	{
+		return static_cast<boost::int16_t>((static_cast<boost::uint16_t>(p[0]) << 8) | p[1]);
+	}
+
+	// Stores a big-endian int16 at p.
+	static void storeInt16(boost::int16_t value, boost::uint8_t* p)
+	{
+		p[0] = static_cast<boost::uint8_t>(value >> 8);
+		p[1] = static_cast<boost::uint8_t>(value);
+	}
+
+	static boost::int16_t loadInt16(const boost::uint8_t* p, ByteOrder byteOrder)
+	{
+		return (byteOrder == BYTE_ORDER_BIG_ENDIAN) ? loadInt16(p) :
+			static_cast<boost::int16_t>((static_cast<boost::uint16_t>(p[1]) << 8) | p[0]);
+	}
+
+	static void storeInt16(boost::int16_t value, boost::uint8_t* p, ByteOrder byteOrder)
+	{
+		if (byteOrder == BYTE_ORDER_BIG_ENDIAN) {
+			storeInt16(value, p);
+		} else {
+			p[0] = static_cast<boost::uint8_t>(value);
+			p[1] = static_cast<boost::uint8_t>(value >> 8);
+		}
+	}
 
 	boost::uint8_t& front()
 	{
-		return buffer_.front();
+		return *data_;
 	}
 
 	const boost::uint8_t& front() const
 	{
-		return buffer_.front();
+		return *data_;
+	}
+
+	const boost::uint8_t* data() const
+	{
+		return data_;
 	}
 
 	std::size_t size() const
 	{
-		return buffer_.size();
+		return size_;
+	}
+
+	// Allocated bytes.
+	std::size_t capacity() const
+	{
+		return capacity_;
+	}
+
+	bool atEnd() const
+	{
+		return readIndex_ >= size_;
+	}
+
+	std::size_t readPosition() const
+	{
+		return readIndex_;
 	}
 private:
 	RawBuffer(const RawBuffer&);
 	RawBuffer& operator=(const RawBuffer&);
 
-	static void writeUInt32(boost::uint32_t value, std::vector<boost::uint8_t>&buffer, std::size_t& index);
-	static boost::uint32_t readUInt32(const std::vector<boost::uint8_t>&buffer, std::size_t& index);
-	static void writeInt16(boost::int16_t value, std::vector<boost::uint8_t>&buffer, std::size_t& index);
-	static boost::int16_t readInt16(const std::vector<boost::uint8_t>&buffer, std::size_t& index);
-
+	void writeUInt32(boost::uint32_t value, boost::uint8_t* buffer, std::size_t& index) const;
+	boost::uint32_t readUInt32(const boost::uint8_t* buffer, std::size_t& index) const;
+	void writeInt16(boost::int16_t value, boost::uint8_t* buffer, std::size_t& index) const;
+	boost::int16_t readInt16(const boost::uint8_t* buffer, std::size_t& index) const;
+	template<typename T> void getInt16ArrayElements(T* a, std::size_t arraySize);
+	void extend(std::size_t size);
+	void grow(std::size_t minCapacity);
+	void freeStorage();
+
+	boost::uint8_t* data_;
+	std::size_t size_;
+	std::size_t capacity_;
 	std::size_t readIndex_;
-	std::vector<boost::uint8_t> buffer_; // big-endian
+	RawBufferPool* pool_;
+	RawBufferPool* storagePool_; // the pool that owns data_, or null
+	ByteOrder byteOrder_;
 };
 
 /*******************************************************************************
@@ -117,12 +238,19 @@ private:
  */
 inline
 void
-RawBuffer::writeUInt32(boost::uint32_t value, std::vector<boost::uint8_t>&buffer, std::size_t& index)
+RawBuffer::writeUInt32(boost::uint32_t value, boost::uint8_t* buffer, std::size_t& index) const
 {
-	buffer[index++] = value >> 24;
-	buffer[index++] = value >> 16;
-	buffer[index++] = value >> 8;
-	buffer[index++] = value;
+	if (byteOrder_ == BYTE_ORDER_BIG_ENDIAN) {
+		buffer[index++] = value >> 24;
+		buffer[index++] = value >> 16;
+		buffer[index++] = value >> 8;
+		buffer[index++] = value;
+	} else {
+		buffer[index++] = value;
+		buffer[index++] = value >> 8;
+		buffer[index++] = value >> 16;
+		buffer[index++] = value >> 24;
+	}
 }
 
 /*******************************************************************************
@@ -130,13 +258,21 @@ RawBuffer::writeUInt32(boost::uint32_t value, std::vector<boost::uint8_t>&buffer
  */
 inline
 boost::uint32_t
-RawBuffer::readUInt32(const std::vector<boost::uint8_t>&buffer, std::size_t& index)
+RawBuffer::readUInt32(const boost::uint8_t* buffer, std::size_t& index) const
 {
-	boost::uint32_t value = buffer[index++] << 24;
-	value                += buffer[index++] << 16;
-	value                += buffer[index++] << 8;
-	value                += buffer[index++];
-	return value;
+	if (byteOrder_ == BYTE_ORDER_BIG_ENDIAN) {
+		boost::uint32_t value = buffer[index++] << 24;
+		value                += buffer[index++] << 16;
+		value                += buffer[index++] << 8;
+		value                += buffer[index++];
+		return value;
+	} else {
+		boost::uint32_t value = buffer[index++];
+		value                += buffer[index++] << 8;
+		value                += buffer[index++] << 16;
+		value                += static_cast<boost::uint32_t>(buffer[index++]) << 24;
+		return value;
+	}
 }
 
 /*******************************************************************************
@@ -144,10 +280,10 @@ RawBuffer::readUInt32(const std::vector<boost::uint8_t>&buffer, std::size_t& ind
  */
 inline
 void
-RawBuffer::writeInt16(boost::int16_t value, std::vector<boost::uint8_t>&buffer, std::size_t& index)
+RawBuffer::writeInt16(boost::int16_t value, boost::uint8_t* buffer, std::size_t& index) const
 {
-	buffer[index++] = static_cast<boost::uint8_t>(value >> 8);
-	buffer[index++] = static_cast<boost::uint8_t>(value);
+	storeInt16(value, &buffer[index], byteOrder_);
+	index += sizeof(boost::int16_t);
 }
 
 /*******************************************************************************
@@ -155,15 +291,11 @@ RawBuffer::writeInt16(boost::int16_t value, std::vector<boost::uint8_t>&buffer,
  */
 inline
 boost::int16_t
-RawBuffer::readInt16(const std::vector<boost::uint8_t>&buffer, std::size_t& index)
+RawBuffer::readInt16(const boost::uint8_t* buffer, std::size_t& index) const
 {
-	union {
-		boost::int16_t i;
-		boost::uint16_t ui;
-	};
-	ui  = buffer[index++] << 8;
-	ui += buffer[index++];
-	return i;
+	const boost::int16_t value = loadInt16(&buffer[index], byteOrder_);
+	index += sizeof(boost::int16_t);
+	return value;
 }
 
 /*******************************************************************************
@@ -174,7 +306,7 @@ void
 RawBuffer::reset()
 {
 	readIndex_ = 0;
-	buffer_.resize(0);
+	size_ = 0;
 }
 
 /*******************************************************************************
@@ -185,7 +317,89 @@ void
 RawBuffer::reserve(std::size_t size)
 {
 	readIndex_ = 0;
-	buffer_.resize(size);
+	if (size > capacity_) grow(size);
+	size_ = size;
+}
+
+/*******************************************************************************
+ *
+ */
+inline
+void
+RawBuffer::clear()
+{
+	reset();
+	freeStorage();
+}
+
+/*******************************************************************************
+ * Exchanges the contents, including the read positions.
+ */
+inline
+void
+RawBuffer::swap(RawBuffer& other)
+{
+	std::swap(data_, other.data_);
+	std::swap(size_, other.size_);
+	std::swap(capacity_, other.capacity_);
+	std::swap(readIndex_, other.readIndex_);
+	std::swap(storagePool_, other.storagePool_);
+}
+
+/*******************************************************************************
+ * Appends size bytes, not initialized.
+ */
+inline
+void
+RawBuffer::extend(std::size_t size)
+{
+	if (size > capacity_ - size_) grow(size_ + size);
+	size_ += size;
+}
+
+/*******************************************************************************
+ * Reallocates the storage, keeping the contents.
+ */
+inline
+void
+RawBuffer::grow(std::size_t minCapacity)
+{
+	boost::uint8_t* data;
+	std::size_t capacity;
+	RawBufferPool* storagePool = nullptr;
+	if (pool_ && pool_->blockSize() > INITIAL_RESERVED_SIZE &&
+			minCapacity > INITIAL_RESERVED_SIZE && minCapacity <= pool_->blockSize()) {
+		data = pool_->acquire();
+		capacity = pool_->blockSize();
+		storagePool = pool_;
+	} else {
+		capacity = std::max<std::size_t>(minCapacity, std::max<std::size_t>(2 * capacity_, INITIAL_RESERVED_SIZE));
+		data = new boost::uint8_t[capacity];
+	}
+	if (size_ > 0) {
+		memcpy(data, data_, size_);
+	}
+	freeStorage();
+	data_ = data;
+	capacity_ = capacity;
+	storagePool_ = storagePool;
+}
+
+/*******************************************************************************
+ * Does not change size_.
+ */
+inline
+void
+RawBuffer::freeStorage()
+{
+	if (storagePool_) {
+		storagePool_->release(data_);
+	} else {
+		delete [] data_;
+	}
+	data_ = nullptr;
+	capacity_ = 0;
+	storagePool_ = nullptr;
 }
 
 /*******************************************************************************
@@ -195,9 +409,9 @@ inline
 void
 RawBuffer::putInt16(boost::int16_t value)
 {
-	std::size_t endIndex = buffer_.size();
-	buffer_.resize(endIndex + sizeof(value));
-	writeInt16(value, buffer_, endIndex);
+	std::size_t endIndex = size_;
+	extend(sizeof(value));
+	writeInt16(value, data_, endIndex);
 }
 
 /*******************************************************************************
@@ -207,11 +421,11 @@ inline
 boost::int16_t
 RawBuffer::getInt16()
 {
-	if (readIndex_ > buffer_.size() - sizeof(boost::int16_t)) {
+	if (size_ - readIndex_ < sizeof(boost::int16_t)) {
 		THROW_EXCEPTION(EndOfBufferException, "Could not get an int16 from the buffer.");
 	}
 
-	return readInt16(buffer_, readIndex_);
+	return readInt16(data_, readIndex_);
 }
 
 /*******************************************************************************
@@ -221,9 +435,9 @@ inline
 void
 RawBuffer::putUInt32(boost::uint32_t value)
 {
-	std::size_t endIndex = buffer_.size();
-	buffer_.resize(endIndex + sizeof(value));
-	writeUInt32(value, buffer_, endIndex);
+	std::size_t endIndex = size_;
+	extend(sizeof(value));
+	writeUInt32(value, data_, endIndex);
 }
 
 /*******************************************************************************
@@ -233,11 +447,11 @@ inline
 boost::uint32_t
 RawBuffer::getUInt32()
 {
-	if (readIndex_ > buffer_.size() - sizeof(boost::uint32_t)) {
+	if (size_ - readIndex_ < sizeof(boost::uint32_t)) {
 		THROW_EXCEPTION(EndOfBufferException, "Could not get a uint32 from the buffer.");
 	}
 
-	return readUInt32(buffer_, readIndex_);
+	return readUInt32(data_, readIndex_);
 }
 
 /*******************************************************************************
@@ -252,9 +466,9 @@ RawBuffer::putFloat(float value)
 		float f;
 	};
 	f = value;
-	std::size_t endIndex = buffer_.size();
-	buffer_.resize(endIndex + sizeof(value));
-	writeUInt32(i, buffer_, endIndex);
+	std::size_t endIndex = size_;
+	extend(sizeof(value));
+	writeUInt32(i, data_, endIndex);
 }
 
 /*******************************************************************************
@@ -264,7 +478,7 @@ inline
 float
 RawBuffer::getFloat()
 {
-	if (readIndex_ > buffer_.size() - sizeof(float)) {
+	if (size_ - readIndex_ < sizeof(float)) {
 		THROW_EXCEPTION(EndOfBufferException, "Could not get a float from the buffer.");
 	}
 
@@ -272,7 +486,7 @@ RawBuffer::getFloat()
 		boost::uint32_t i;
 		float f;
 	};
-	i = readUInt32(buffer_, readIndex_);
+	i = readUInt32(data_, readIndex_);
 	return f;
 }
 
@@ -282,14 +496,35 @@ RawBuffer::getFloat()
 inline
 void
 RawBuffer::putString(const std::string& s)
+{
+	putString(s.data(), s.size());
+}
+
+/*******************************************************************************
+ *
+ */
+inline
+void
+RawBuffer::putString(const char* s)
+{
+	putString(s, strlen(s));
+}
+
+/*******************************************************************************
+ *
+ */
+inline
+void
+RawBuffer::putString(const char* s, std::size_t size)
 {
 	//TODO: check size (max uint32)
-	std::size_t stringSize = s.size();
-	putUInt32(stringSize);
+	putUInt32(size);
 
-	std::size_t endIndex = buffer_.size();
-	buffer_.resize(endIndex + stringSize);
-	memcpy(&buffer_[endIndex], &s[0], stringSize);
+	std::size_t endIndex = size_;
+	extend(size);
+	if (size > 0) {
+		memcpy(data_ + endIndex, s, size);
+	}
 }
 
 /*******************************************************************************
@@ -298,16 +533,39 @@ RawBuffer::putString(const std::string& s)
 inline
 void
 RawBuffer::getString(std::string& s)
+{
+	const boost::string_view view = getStringView();
+	s.assign(view.data(), view.size());
+}
+
+/*******************************************************************************
+ *
+ */
+inline
+boost::string_view
+RawBuffer::getStringView()
 {
 	boost::uint32_t stringSize = getUInt32();
 
-	if (readIndex_ > buffer_.size() - stringSize) {
+	if (size_ - readIndex_ < stringSize) {
 		THROW_EXCEPTION(EndOfBufferException, "Could not get the string from the buffer.");
 	}
 
-	s.resize(stringSize);
-	memcpy(&s[0], &buffer_[readIndex_], stringSize);
+	const boost::string_view view(reinterpret_cast<const char*>(data_ + readIndex_), stringSize);
 	readIndex_ += stringSize;
+	return view;
+}
+
+/*******************************************************************************
+ * Appends size bytes, to be written by the caller. Returns a pointer to them.
+ */
+inline
+boost::uint8_t*
+RawBuffer::putSpace(std::size_t size)
+{
+	const std::size_t endIndex = size_;
+	extend(size);
+	return data_ + endIndex;
 }
 
 /*******************************************************************************
@@ -321,15 +579,13 @@ RawBuffer::putFloatArray(const std::vector<float>& a)
 	std::size_t arraySize = a.size();
 	putUInt32(arraySize);
 
-	union {
-		boost::uint32_t i;
-		float f;
-	};
-	std::size_t endIndex = buffer_.size();
-	buffer_.resize(endIndex + arraySize * sizeof(boost::uint32_t));
-	for (boost::uint32_t j = 0; j < arraySize; ++j) {
-		f = a[j];
-		writeUInt32(i, buffer_, endIndex);
+	std::size_t endIndex = size_;
+	extend(arraySize * sizeof(boost::uint32_t));
+	if (arraySize == 0) return;
+	if (isNative(byteOrder_)) {
+		memcpy(data_ + endIndex, &a[0], arraySize * sizeof(float));
+	} else {
+		ByteSwap::copySwap32(&a[0], arraySize, data_ + endIndex);
 	}
 }
 
@@ -342,19 +598,33 @@ RawBuffer::getFloatArray(std::vector<float>& a)
 {
 	boost::uint32_t arraySize = getUInt32();
 
-	if (readIndex_ > buffer_.size() - arraySize * sizeof(float)) {
+	if (size_ - readIndex_ < arraySize * sizeof(float)) {
 		THROW_EXCEPTION(EndOfBufferException, "Could not get the float array from the buffer.");
 	}
 
 	a.resize(arraySize);
-	union {
-		boost::uint32_t i;
-		float f;
-	};
-	for (boost::uint32_t j = 0; j < arraySize; ++j) {
-		i = readUInt32(buffer_, readIndex_);
-		a[j] = f;
+	if (arraySize == 0) return;
+	getFloatArrayElements(&a[0], arraySize);
+}
+
+/*******************************************************************************
+ *
+ */
+inline
+void
+RawBuffer::getFloatArrayElements(float* a, std::size_t arraySize)
+{
+	if (size_ - readIndex_ < arraySize * sizeof(float)) {
+		THROW_EXCEPTION(EndOfBufferException, "Could not get the float array from the buffer.");
 	}
+
+	if (arraySize == 0) return;
+	if (isNative(byteOrder_)) {
+		memcpy(a, data_ + readIndex_, arraySize * sizeof(float));
+	} else {
+		ByteSwap::copySwap32(data_ + readIndex_, arraySize, a);
+	}
+	readIndex_ += arraySize * sizeof(float);
 }
 
 /*******************************************************************************
@@ -378,10 +648,19 @@ RawBuffer::putInt16Array(const T* a, std::size_t arraySize)
 	//TODO: check size (max uint32)
 	putUInt32(arraySize);
 
-	std::size_t endIndex = buffer_.size();
-	buffer_.resize(endIndex + arraySize * sizeof(boost::int16_t));
+	std::size_t endIndex = size_;
+	extend(arraySize * sizeof(boost::int16_t));
+	if (std::is_same<T, boost::int16_t>::value) {
+		if (arraySize == 0) return;
+		if (isNative(byteOrder_)) {
+			memcpy(data_ + endIndex, a, arraySize * sizeof(boost::int16_t));
+		} else {
+			ByteSwap::copySwap16(a, arraySize, data_ + endIndex);
+		}
+		return;
+	}
 	for (boost::uint32_t j = 0; j < arraySize; ++j) {
-		writeInt16(static_cast<boost::int16_t>(a[j]), buffer_, endIndex);
+		writeInt16(static_cast<boost::int16_t>(a[j]), data_, endIndex);
 	}
 }
 
@@ -394,14 +673,12 @@ RawBuffer::getInt16Array(std::vector<T>& a)
 {
 	boost::uint32_t arraySize = getUInt32();
 
-	if (readIndex_ > buffer_.size() - arraySize * sizeof(boost::int16_t)) {
+	if (size_ - readIndex_ < arraySize * sizeof(boost::int16_t)) {
 		THROW_EXCEPTION(EndOfBufferException, "Could not get the int16 array from the buffer.");
 	}
 
 	a.resize(arraySize);
-	for (boost::uint32_t j = 0; j < arraySize; ++j) {
-		a[j] = static_cast<T>(readInt16(buffer_, readIndex_));
-	}
+	getInt16ArrayElements(a.data(), arraySize);
 }
 
 /*******************************************************************************
@@ -416,13 +693,54 @@ RawBuffer::getInt16Array(T* a, std::size_t arraySize)
 		THROW_EXCEPTION(WrongBufferSizeException, "Wrong buffer size. Received=" << receivedArraySize << ", correct=" << arraySize << '.');
 	}
 
-	if (readIndex_ > buffer_.size() - arraySize * sizeof(boost::int16_t)) {
+	if (size_ - readIndex_ < arraySize * sizeof(boost::int16_t)) {
 		THROW_EXCEPTION(EndOfBufferException, "Could not get the int16 array from the buffer.");
 	}
 
-	for (boost::uint32_t j = 0; j < arraySize; ++j) {
-		a[j] = static_cast<T>(readInt16(buffer_, readIndex_));
+	getInt16ArrayElements(a, arraySize);
+}
+
+/*******************************************************************************
+ *
+ */
+template<typename T>
+void
+RawBuffer::getInt16ArrayElements(T* a, std::size_t arraySize)
+{
+	if (std::is_same<T, boost::int16_t>::value) {
+		if (arraySize == 0) return;
+		if (isNative(byteOrder_)) {
+			memcpy(a, data_ + readIndex_, arraySize * sizeof(boost::int16_t));
+		} else {
+			ByteSwap::copySwap16(data_ + readIndex_, arraySize, a);
+		}
+		readIndex_ += arraySize * sizeof(boost::int16_t);
+		return;
+	}
+	for (std::size_t j = 0; j < arraySize; ++j) {
+		a[j] = static_cast<T>(readInt16(data_, readIndex_));
+	}
+}
+
+/*******************************************************************************
+ * Appends an int16 array whose elements will be written by the caller.
+ *
+ * Returns a pointer to the first element. The elements must be stored
+ * in the byte order of the buffer (see storeInt16). The pointer is
+ * invalidated by the next put* call.
+ */
+inline
+boost::uint8_t*
+RawBuffer::putInt16ArraySpace(std::size_t arraySize)
+{
+	if (arraySize > std::numeric_limits<boost::uint32_t>::max()) {
+		THROW_EXCEPTION(WrongBufferSizeException, "The int16 array is too large (size: " << arraySize << ").");
 	}
+	putUInt32(arraySize);
+
+	const std::size_t endIndex = size_;
+	extend(arraySize * sizeof(boost::int16_t));
+	return data_ + endIndex;
 }
 
 } // namespace Lab
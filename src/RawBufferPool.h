@@ -0,0 +1,131 @@
+/*
+
+  Copyright (c) 2013, 2017, 2018, 2019 Marcelo Y. Matuda.
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice,
+       this list of conditions and the following disclaimer.
+    2. Redistributions in binary form must reproduce the above copyright
+       notice, this list of conditions and the following disclaimer in the
+       documentation and/or other materials provided with the distribution.
+    3. Neither the name of the copyright holder nor the names of its
+       contributors may be used to endorse or promote products derived from
+       this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+  OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+  WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+  OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+  ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#ifndef RAWBUFFERPOOL_H_
+#define RAWBUFFERPOOL_H_
+
+#include <cstddef> /* std::size_t */
+#include <mutex>
+#include <vector>
+
+#include <boost/cstdint.hpp>
+
+
+
+namespace Lab {
+
+/*******************************************************************************
+ * Pool of uninitialized storage blocks of blockSize bytes, used by RawBuffer.
+ *
+ * The released blocks are kept for reuse, up to maxFreeBlocks. The other
+ * blocks are freed.
+ *
+ * Thread-safe. The pool must outlive the buffers that use it.
+ */
+class RawBufferPool {
+public:
+	RawBufferPool(std::size_t blockSize, std::size_t maxFreeBlocks);
+	~RawBufferPool();
+
+	std::size_t blockSize() const { return blockSize_; }
+
+	boost::uint8_t* acquire();
+	void release(boost::uint8_t* block);
+private:
+	RawBufferPool(const RawBufferPool&) = delete;
+	RawBufferPool& operator=(const RawBufferPool&) = delete;
+
+	const std::size_t blockSize_;
+	const std::size_t maxFreeBlocks_;
+	std::mutex mutex_;
+	std::vector<boost::uint8_t*> freeBlocks_; // protected by mutex_
+};
+
+/*******************************************************************************
+ * Constructor.
+ */
+inline
+RawBufferPool::RawBufferPool(std::size_t blockSize, std::size_t maxFreeBlocks)
+		: blockSize_(blockSize)
+		, maxFreeBlocks_(maxFreeBlocks)
+{
+	freeBlocks_.reserve(maxFreeBlocks_);
+}
+
+/*******************************************************************************
+ * Destructor.
+ */
+inline
+RawBufferPool::~RawBufferPool()
+{
+	for (boost::uint8_t* block : freeBlocks_) {
+		delete [] block;
+	}
+}
+
+/*******************************************************************************
+ * Returns a block of blockSize() bytes, not initialized.
+ */
+inline
+boost::uint8_t*
+RawBufferPool::acquire()
+{
+	{
+		std::lock_guard<std::mutex> locker(mutex_);
+		if (!freeBlocks_.empty()) {
+			boost::uint8_t* block = freeBlocks_.back();
+			freeBlocks_.pop_back();
+			return block;
+		}
+	}
+	return new boost::uint8_t[blockSize_];
+}
+
+/*******************************************************************************
+ * block must have been returned by acquire().
+ */
+inline
+void
+RawBufferPool::release(boost::uint8_t* block)
+{
+	{
+		std::lock_guard<std::mutex> locker(mutex_);
+		if (freeBlocks_.size() < maxFreeBlocks_) {
+			freeBlocks_.push_back(block);
+			return;
+		}
+	}
+	delete [] block;
+}
+
+} // namespace Lab
+
+#endif /* RAWBUFFERPOOL_H_ */
@@ -0,0 +1,149 @@
+/*
+
+  Copyright (c) 2013, 2017, 2018, 2019 Marcelo Y. Matuda.
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice,
+       this list of conditions and the following disclaimer.
+    2. Redistributions in binary form must reproduce the above copyright
+       notice, this list of conditions and the following disclaimer in the
+       documentation and/or other materials provided with the distribution.
+    3. Neither the name of the copyright holder nor the names of its
+       contributors may be used to endorse or promote products derived from
+       this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+  OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+  WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+  OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+  ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#ifndef SAMPLEPACKING_H_
+#define SAMPLEPACKING_H_
+
+#include <cstddef> /* std::size_t */
+#include <cstring>
+
+#include <boost/cstdint.hpp>
+
+#ifdef __SSSE3__
+# include <tmmintrin.h>
+#endif
+
+#include "RawBuffer.h"
+
+
+
+namespace Lab {
+
+/*******************************************************************************
+ * 12-bit packed samples.
+ *
+ * Each pair of samples (a, b), in the range -2048 ... 2047, is stored in
+ * three bytes:
+ *     byte 0: a bits 11-4
+ *     byte 1: a bits 3-0 (high nibble), b bits 11-8 (low nibble)
+ *     byte 2: b bits 7-0
+ * If the number of samples is odd, the last b is zero.
+ *
+ * unpack12Reference() is the reference decoder for the clients.
+ */
+namespace SamplePacking {
+
+inline std::size_t packed12Size(std::size_t numSamples) { return (numSamples + 1) / 2 * 3; }
+
+// src: int16 samples in the given byte order.
+void pack12(const boost::uint8_t* src, std::size_t numSamples, RawBuffer::ByteOrder byteOrder, boost::uint8_t* dest);
+void unpack12(const boost::uint8_t* src, std::size_t numSamples, boost::int16_t* dest);
+void unpack12Reference(const boost::uint8_t* src, std::size_t numSamples, boost::int16_t* dest);
+
+
+
+inline
+void
+pack12(const boost::uint8_t* src, std::size_t numSamples, RawBuffer::ByteOrder byteOrder, boost::uint8_t* dest)
+{
+	std::size_t i = 0;
+#ifdef __SSSE3__
+	// 8 samples -> 12 bytes.
+	const __m128i swapMask = _mm_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+	const __m128i packMask = _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+	const __m128i mask12 = _mm_set1_epi32(0x0FFF);
+	const bool swap = !RawBuffer::isNative(byteOrder);
+	for ( ; i + 8 <= numSamples; i += 8, src += 16, dest += 12) {
+		__m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+		if (swap) x = _mm_shuffle_epi8(x, swapMask);
+		// 32-bit lane: a (low half), b (high half) -> (a << 12) | b
+		const __m128i a = _mm_slli_epi32(_mm_and_si128(x, mask12), 12);
+		const __m128i b = _mm_and_si128(_mm_srli_epi32(x, 16), mask12);
+		const __m128i packed = _mm_shuffle_epi8(_mm_or_si128(a, b), packMask);
+		_mm_storel_epi64(reinterpret_cast<__m128i*>(dest), packed);
+		const boost::uint32_t tail = _mm_cvtsi128_si32(_mm_srli_si128(packed, 8));
+		std::memcpy(dest + 8, &tail, sizeof(tail));
+	}
+#endif
+	for ( ; i + 2 <= numSamples; i += 2, src += 4, dest += 3) {
+		const boost::uint16_t a = RawBuffer::loadInt16(src, byteOrder);
+		const boost::uint16_t b = RawBuffer::loadInt16(src + 2, byteOrder);
+		dest[0] = static_cast<boost::uint8_t>(a >> 4);
+		dest[1] = static_cast<boost::uint8_t>(((a & 0x0F) << 4) | ((b >> 8) & 0x0F));
+		dest[2] = static_cast<boost::uint8_t>(b);
+	}
+	if (i < numSamples) {
+		const boost::uint16_t a = RawBuffer::loadInt16(src, byteOrder);
+		dest[0] = static_cast<boost::uint8_t>(a >> 4);
+		dest[1] = static_cast<boost::uint8_t>((a & 0x0F) << 4);
+		dest[2] = 0;
+	}
+}
+
+inline
+void
+unpack12(const boost::uint8_t* src, std::size_t numSamples, boost::int16_t* dest)
+{
+	std::size_t i = 0;
+#ifdef __SSSE3__
+	// 12 bytes -> 8 samples. Each load reads 16 bytes.
+	const std::size_t srcSize = packed12Size(numSamples);
+	const __m128i unpackMask = _mm_setr_epi8(2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1);
+	const __m128i mask16 = _mm_set1_epi32(0xFFFF);
+	for ( ; i + 8 <= numSamples && (i / 2) * 3 + 16 <= srcSize; i += 8, src += 12, dest += 8) {
+		const __m128i v = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src)), unpackMask);
+		// Sign extension of the 12-bit values.
+		const __m128i a = _mm_srai_epi32(_mm_slli_epi32(v, 8), 20);
+		const __m128i b = _mm_srai_epi32(_mm_slli_epi32(v, 20), 20);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dest), _mm_or_si128(_mm_and_si128(a, mask16), _mm_slli_epi32(b, 16)));
+	}
+#endif
+	unpack12Reference(src, numSamples - i, dest);
+}
+
+inline
+void
+unpack12Reference(const boost::uint8_t* src, std::size_t numSamples, boost::int16_t* dest)
+{
+	for (std::size_t i = 0; i < numSamples; i += 2, src += 3) {
+		const int a = (src[0] << 4) | (src[1] >> 4);
+		dest[i] = static_cast<boost::int16_t>(a >= 2048 ? a - 4096 : a);
+		if (i + 1 < numSamples) {
+			const int b = ((src[1] & 0x0F) << 8) | src[2];
+			dest[i + 1] = static_cast<boost::int16_t>(b >= 2048 ? b - 4096 : b);
+		}
+	}
+}
+
+} // namespace SamplePacking
+} // namespace Lab
+
+#endif /* SAMPLEPACKING_H_ */
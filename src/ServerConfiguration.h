@@ -0,0 +1,81 @@
+/*
+
+  Copyright (c) 2013, 2017, 2018, 2019 Marcelo Y. Matuda.
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice,
+       this list of conditions and the following disclaimer.
+    2. Redistributions in binary form must reproduce the above copyright
+       notice, this list of conditions and the following disclaimer in the
+       documentation and/or other materials provided with the distribution.
+    3. Neither the name of the copyright holder nor the names of its
+       contributors may be used to endorse or promote products derived from
+       this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+  OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+  WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+  OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+  ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#ifndef SERVERCONFIGURATION_H_
+#define SERVERCONFIGURATION_H_
+
+#include <cstddef> /* std::size_t */
+#include <string>
+
+
+
+namespace Lab {
+
+/*******************************************************************************
+ * Server parameters read from config-server.txt.
+ */
+struct ServerConfiguration {
+	enum IoBackend {
+		IO_BACKEND_ASIO,
+		IO_BACKEND_IO_URING // see IoUring
+	};
+
+	ServerConfiguration()
+			: numThreads(1)
+			, ioBackend(IO_BACKEND_ASIO)
+			, zeroCopySendThreshold()
+			, statisticsLogPeriod()
+			, sessionMemoryBudget(256 * 1024 * 1024)
+			, maxRequestDataSize(4 * 1024 * 1024)
+			, maxSessions()
+	{}
+
+	unsigned int numThreads;
+	IoBackend ioBackend;
+	// With io_uring, the writes of at least this number of bytes use zero-copy send. 0: disabled.
+	std::size_t zeroCopySendThreshold;
+	// Period (s) of the log of the message statistics. 0: disabled.
+	unsigned int statisticsLogPeriod;
+	// The server statistics are written periodically to this file. Empty: disabled.
+	std::string metricsFile;
+	// Unix domain socket that sends the server statistics to each client. Empty: disabled.
+	std::string metricsSocket;
+	// Limit (bytes) of the buffers of each session (see ArrayAcqProtocol::setMemoryBudget()).
+	std::size_t sessionMemoryBudget;
+	// Data size limit (bytes) of the requests with variable size (see ArrayAcqServerProtocol).
+	unsigned int maxRequestDataSize;
+	// The connections above this number of sessions are closed. 0: unlimited.
+	unsigned int maxSessions;
+};
+
+} // namespace Lab
+
+#endif /* SERVERCONFIGURATION_H_ */
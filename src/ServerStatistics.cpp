@@ -0,0 +1,165 @@
+/*
+
+  Copyright (c) 2013, 2017, 2018, 2019 Marcelo Y. Matuda.
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice,
+       this list of conditions and the following disclaimer.
+    2. Redistributions in binary form must reproduce the above copyright
+       notice, this list of conditions and the following disclaimer in the
+       documentation and/or other materials provided with the distribution.
+    3. Neither the name of the copyright holder nor the names of its
+       contributors may be used to endorse or promote products derived from
+       this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+  OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+  WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+  OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+  ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "ServerStatistics.h"
+
+#include <fstream>
+
+#include <unistd.h> /* sysconf */
+
+#include "ArrayAcqProtocol.h"
+
+
+
+namespace Lab {
+
+namespace {
+
+void
+writeMetricHeader(std::ostream& out, const char* name, const char* type, const char* help)
+{
+	out << "# HELP " << name << ' ' << help << "\n# TYPE " << name << ' ' << type << '\n';
+}
+
+} // namespace
+
+ServerStatistics::ServerStatistics()
+		: nextSessionId_(1)
+		, messageStatistics_(ArrayAcqProtocol::firstMessageType(), ArrayAcqProtocol::numMessageTypes())
+{
+}
+
+ServerStatistics::~ServerStatistics()
+{
+}
+
+unsigned int
+ServerStatistics::addSession(const std::string& clientName)
+{
+	std::lock_guard<std::mutex> locker(mutex_);
+	const unsigned int id = nextSessionId_++;
+	sessions_[id].clientName = clientName;
+	return id;
+}
+
+void
+ServerStatistics::updateSession(unsigned int sessionId, const SessionCounters& counters,
+					const MessageStatistics& messageStatistics)
+{
+	std::lock_guard<std::mutex> locker(mutex_);
+	auto iter = sessions_.find(sessionId);
+	if (iter != sessions_.end()) iter->second.counters = counters;
+	messageStatistics_.add(messageStatistics);
+}
+
+void
+ServerStatistics::removeSession(unsigned int sessionId)
+{
+	std::lock_guard<std::mutex> locker(mutex_);
+	auto iter = sessions_.find(sessionId);
+	if (iter == sessions_.end()) return;
+	const SessionCounters& c = iter->second.counters;
+	removedSessionsCounters_.bytesReceived += c.bytesReceived;
+	removedSessionsCounters_.bytesSent     += c.bytesSent;
+	removedSessionsCounters_.framesSent    += c.framesSent;
+	removedSessionsCounters_.signalTime    += c.signalTime;
+	sessions_.erase(iter);
+}
+
+MessageStatistics
+ServerStatistics::messageStatistics() const
+{
+	std::lock_guard<std::mutex> locker(mutex_);
+	return messageStatistics_;
+}
+
+void
+ServerStatistics::writeMetrics(std::ostream& out) const
+{
+	const std::size_t rss = residentSetSize();
+
+	std::lock_guard<std::mutex> locker(mutex_);
+
+	SessionCounters total = removedSessionsCounters_;
+	for (const auto& item : sessions_) {
+		const SessionCounters& c = item.second.counters;
+		total.bytesReceived  += c.bytesReceived;
+		total.bytesSent      += c.bytesSent;
+		total.framesSent     += c.framesSent;
+		total.signalTime     += c.signalTime;
+		total.bufferCapacity += c.bufferCapacity;
+	}
+
+	const std::streamsize precision = out.precision(9);
+
+	writeMetricHeader(out, "us_lab4a_sessions", "gauge", "Connected clients.");
+	out << "us_lab4a_sessions " << sessions_.size() << '\n';
+	writeMetricHeader(out, "us_lab4a_frames_served_total", "counter", "Signal frames sent to the clients.");
+	out << "us_lab4a_frames_served_total " << total.framesSent << '\n';
+	writeMetricHeader(out, "us_lab4a_received_bytes_total", "counter", "Bytes received from the clients.");
+	out << "us_lab4a_received_bytes_total " << total.bytesReceived << '\n';
+	writeMetricHeader(out, "us_lab4a_sent_bytes_total", "counter", "Bytes sent to the clients (without the shared memory).");
+	out << "us_lab4a_sent_bytes_total " << total.bytesSent << '\n';
+	writeMetricHeader(out, "us_lab4a_signal_generation_seconds_total", "counter", "Time spent by the device generating the frames.");
+	out << "us_lab4a_signal_generation_seconds_total "
+		<< std::chrono::duration<double>(total.signalTime).count() << '\n';
+	writeMetricHeader(out, "us_lab4a_buffer_capacity_bytes", "gauge", "Memory allocated by the protocol buffers of the sessions.");
+	out << "us_lab4a_buffer_capacity_bytes " << total.bufferCapacity << '\n';
+	writeMetricHeader(out, "process_resident_memory_bytes", "gauge", "Resident memory size in bytes.");
+	out << "process_resident_memory_bytes " << rss << '\n';
+
+	writeMetricHeader(out, "us_lab4a_session_receive_bytes_per_second", "gauge", "Receive throughput of each session.");
+	for (const auto& item : sessions_) {
+		out << "us_lab4a_session_receive_bytes_per_second{session=\"" << item.first
+			<< "\",client=\"" << item.second.clientName << "\"} " << item.second.counters.receiveRate << '\n';
+	}
+	writeMetricHeader(out, "us_lab4a_session_send_bytes_per_second", "gauge", "Send throughput of each session.");
+	for (const auto& item : sessions_) {
+		out << "us_lab4a_session_send_bytes_per_second{session=\"" << item.first
+			<< "\",client=\"" << item.second.clientName << "\"} " << item.second.counters.sendRate << '\n';
+	}
+
+	messageStatistics_.writeMetrics(out, "us_lab4a_message_latency_seconds", &ArrayAcqProtocol::messageTypeName);
+	messageStatistics_.writeAllocationMetrics(out, "us_lab4a_message_allocations_total", &ArrayAcqProtocol::messageTypeName);
+
+	out.precision(precision);
+}
+
+std::size_t
+ServerStatistics::residentSetSize()
+{
+	std::ifstream in("/proc/self/statm");
+	std::size_t size = 0, resident = 0;
+	if (!(in >> size >> resident)) return 0;
+	return resident * static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+}
+
+} // namespace Lab
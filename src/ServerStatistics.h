@@ -0,0 +1,118 @@
+/*
+
+  Copyright (c) 2013, 2017, 2018, 2019 Marcelo Y. Matuda.
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice,
+       this list of conditions and the following disclaimer.
+    2. Redistributions in binary form must reproduce the above copyright
+       notice, this list of conditions and the following disclaimer in the
+       documentation and/or other materials provided with the distribution.
+    3. Neither the name of the copyright holder nor the names of its
+       contributors may be used to endorse or promote products derived from
+       this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+  OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+  WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+  OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+  ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#ifndef SERVERSTATISTICS_H_
+#define SERVERSTATISTICS_H_
+
+#include <chrono>
+#include <cstddef> /* std::size_t */
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <string>
+
+#include <boost/cstdint.hpp>
+
+#include "MessageStatistics.h"
+
+
+
+namespace Lab {
+
+/*******************************************************************************
+ * Statistics of all the sessions of a server.
+ *
+ * Each session registers itself with addSession(), publishes its counters
+ * and message statistics periodically with updateSession(), and is removed
+ * with removeSession(). The totals include the removed sessions.
+ *
+ * writeMetrics() writes the statistics in the Prometheus text exposition
+ * format (version 0.0.4).
+ *
+ * Thread-safe.
+ */
+class ServerStatistics {
+public:
+	typedef MessageStatistics::Clock Clock;
+
+	struct SessionCounters {
+		SessionCounters()
+				: bytesReceived()
+				, bytesSent()
+				, framesSent()
+				, signalTime()
+				, bufferCapacity()
+				, receiveRate()
+				, sendRate()
+		{}
+
+		boost::uint64_t bytesReceived;
+		boost::uint64_t bytesSent;
+		boost::uint64_t framesSent;
+		Clock::duration signalTime; // in the device, generating the frames
+		std::size_t bufferCapacity; // bytes allocated by the protocol buffers
+		double receiveRate; // bytes/s, in the last period
+		double sendRate;    // bytes/s, in the last period
+	};
+
+	ServerStatistics();
+	~ServerStatistics();
+
+	// Returns the session id.
+	unsigned int addSession(const std::string& clientName);
+	void updateSession(unsigned int sessionId, const SessionCounters& counters,
+				const MessageStatistics& messageStatistics);
+	void removeSession(unsigned int sessionId);
+
+	MessageStatistics messageStatistics() const;
+	void writeMetrics(std::ostream& out) const;
+
+	// Resident set size of the process (bytes). Returns 0 in case of error.
+	static std::size_t residentSetSize();
+private:
+	struct Session {
+		std::string clientName;
+		SessionCounters counters;
+	};
+
+	ServerStatistics(const ServerStatistics&) = delete;
+	ServerStatistics& operator=(const ServerStatistics&) = delete;
+
+	mutable std::mutex mutex_;
+	unsigned int nextSessionId_;
+	std::map<unsigned int, Session> sessions_;
+	SessionCounters removedSessionsCounters_; // only the totals are used
+	MessageStatistics messageStatistics_;
+};
+
+} // namespace Lab
+
+#endif /* SERVERSTATISTICS_H_ */
@@ -38,19 +38,20 @@
 #include "ServerWindow.h"
 #include "TestDevice.h"
 
-#define SLEEP_TIME_MS 1000
-
 
 
 namespace Lab {
 
-ServerThread::ServerThread(const std::string& dataFile, const std::string& datasetName, ServerWindow* serverWindow)
+ServerThread::ServerThread(const std::string& dataFile, const std::string& datasetName, const ServerConfiguration& config,
+			ServerWindow* serverWindow)
 		: QThread(serverWindow)
 		, dataFile_(dataFile)
 		, datasetName_(datasetName)
+		, config_(config)
 		, state_(STATE_DISABLED)
 		, portNumber_()
 		, acqDevice_()
+		, serverPortNumber_()
 		, serverWindow_(serverWindow)
 {
 }
@@ -85,49 +86,60 @@ ServerThread::run()
 	LOG_DEBUG << "Test device open.";
 
 	for (;;) {
-		State localState;
-		unsigned short localPortNumber;
+		ArrayAcqServer<TestDevice>* server;
 		{
 			QMutexLocker locker(&mutex_);
+			while (state_ == STATE_DISABLED && !server_) {
+				LOG_DEBUG << "Server thread: WAIT";
+				condition_.wait(&mutex_);
+			}
 			if (state_ == STATE_EXITING) {
 				break;
 			}
 
-			while (state_ == STATE_DISABLED) {
-				LOG_DEBUG << "Server thread: WAIT";
-				condition_.wait(&mutex_);
+			if (!server_) {
+				try {
+					server_.reset(new ArrayAcqServer<TestDevice>(portNumber_, *acqDevice_, config_));
+					serverPortNumber_ = portNumber_;
+				} catch (std::exception& e) {
+					state_ = STATE_DISABLED;
+					portNumber_ = 0;
+					emit errorOcurred();
+					LOG_ERROR << "Error [" << typeid(e).name() << "]: " << e.what();
+					continue;
+				}
 			}
-			localState = state_;
-			localPortNumber = portNumber_;
+			server = server_.get();
 		}
 
-		if (localState == STATE_ENABLED) {
-			LOG_DEBUG << "Server thread: EXECUTING";
-			try {
-				if (server_) server_.reset(); // closes an open connection
-				server_.reset(new ArrayAcqServer<TestDevice>(localPortNumber, *acqDevice_));
-				server_->exec();
-			} catch (std::bad_alloc& /*e*/) {
-				disableServer();
-				emit errorOcurred();
-				LOG_ERROR << "Error: Out of memory.";
-			} catch (std::exception& e) {
-				disableServer();
-				emit errorOcurred();
-				LOG_ERROR << "Error [" << typeid(e).name() << "]: " << e.what();
-			} catch (...) {
-				disableServer();
-				emit errorOcurred();
-				LOG_ERROR << "Unknown error.";
-			}
+		LOG_DEBUG << "Server thread: EXECUTING";
+		try {
+			// Returns after ArrayAcqServer::stop(), or after an error.
+			server->exec();
+		} catch (std::bad_alloc& /*e*/) {
+			disableServer();
+			emit errorOcurred();
+			LOG_ERROR << "Error: Out of memory.";
+		} catch (std::exception& e) {
+			disableServer();
+			emit errorOcurred();
+			LOG_ERROR << "Error [" << typeid(e).name() << "]: " << e.what();
+		} catch (...) {
+			disableServer();
+			emit errorOcurred();
+			LOG_ERROR << "Unknown error.";
 		}
 
-		msleep(SLEEP_TIME_MS);
+		QMutexLocker locker(&mutex_);
+		server_.reset(); // closes the listening socket and the connections
 	}
 
 	acqDevice_.reset();
 }
 
+/*******************************************************************************
+ * If the port number has not changed, the listening socket is reused.
+ */
 void
 ServerThread::enableServer(unsigned short portNumber)
 {
@@ -135,7 +147,13 @@ ServerThread::enableServer(unsigned short portNumber)
 	if (state_ == STATE_DISABLED) {
 		state_ = STATE_ENABLED;
 		portNumber_ = portNumber;
-		condition_.wakeOne();
+		if (!server_) {
+			condition_.wakeOne();
+		} else if (serverPortNumber_ == portNumber) {
+			server_->enable();
+		} else {
+			server_->stop(); // the server thread creates another server
+		}
 	}
 }
 
@@ -147,7 +165,7 @@ ServerThread::disableServer()
 		state_ = STATE_DISABLED;
 		portNumber_ = 0;
 
-		if (server_) server_->stop();
+		if (server_) server_->disable();
 	}
 }
 
@@ -158,9 +176,9 @@ ServerThread::exitLoop()
 		QMutexLocker locker(&mutex_);
 		state_ = STATE_EXITING;
 		condition_.wakeOne();
-	}
 
-	if (server_) server_->stop();
+		if (server_) server_->stop();
+	}
 
 	wait();
 }
@@ -39,6 +39,8 @@
 #include <QThread>
 #include <QWaitCondition>
 
+#include "ServerConfiguration.h"
+
 
 
 namespace Lab {
@@ -50,7 +52,8 @@ template<typename T> class ArrayAcqServer;
 class ServerThread : public QThread {
 	Q_OBJECT
 public:
-	ServerThread(const std::string& dataFile, const std::string& datasetName, ServerWindow* serverWindow=0);
+	ServerThread(const std::string& dataFile, const std::string& datasetName, const ServerConfiguration& config,
+			ServerWindow* serverWindow=0);
 	virtual ~ServerThread();
 
 	void enableServer(unsigned short portNumber);
@@ -67,12 +70,17 @@ private:
 
 	const std::string dataFile_;
 	const std::string datasetName_;
-	State state_;
-	unsigned short portNumber_;
+	const ServerConfiguration config_;
+	State state_; // protected by mutex_
+	unsigned short portNumber_; // protected by mutex_
 	QMutex mutex_;
 	QWaitCondition condition_;
 	std::unique_ptr<TestDevice> acqDevice_;
-	std::unique_ptr<ArrayAcqServer<TestDevice>> server_;
+	// Created at the first enableServer() and kept while the port number
+	// is not changed, so the listening socket is not closed when the
+	// server is disabled.
+	std::unique_ptr<ArrayAcqServer<TestDevice>> server_; // protected by mutex_
+	unsigned short serverPortNumber_; // protected by mutex_
 	ServerWindow* serverWindow_;
 signals:
 	void errorOcurred();
@@ -47,11 +47,12 @@
 
 namespace Lab {
 
-ServerWindow::ServerWindow(const std::string& dataFile, const std::string& datasetName, QWidget* parent)
+ServerWindow::ServerWindow(const std::string& dataFile, const std::string& datasetName, const ServerConfiguration& config,
+			QWidget* parent)
 		: QMainWindow(parent)
 		, serverThreadEnabled_(false)
 		, logWidgetTimer_(this)
-		, serverThread_(dataFile, datasetName, this)
+		, serverThread_(dataFile, datasetName, config, this)
 {
 	ui_.setupUi(this);
 
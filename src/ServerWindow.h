@@ -52,7 +52,8 @@ class ServerWindow : public QMainWindow
 {
 	Q_OBJECT
 public:
-	ServerWindow(const std::string& dataFile, const std::string& datasetName, QWidget* parent=0);
+	ServerWindow(const std::string& dataFile, const std::string& datasetName, const ServerConfiguration& config,
+			QWidget* parent=0);
 	virtual ~ServerWindow();
 
 	void connectServer(ServerThread& server);
@@ -0,0 +1,139 @@
+/*
+
+  Copyright (c) 2013, 2017, 2018, 2019 Marcelo Y. Matuda.
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice,
+       this list of conditions and the following disclaimer.
+    2. Redistributions in binary form must reproduce the above copyright
+       notice, this list of conditions and the following disclaimer in the
+       documentation and/or other materials provided with the distribution.
+    3. Neither the name of the copyright holder nor the names of its
+       contributors may be used to endorse or promote products derived from
+       this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+  OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+  WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+  OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+  ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "SharedMemoryRing.h"
+
+#include <atomic>
+#include <climits> /* INT_MAX */
+#include <cstdint> /* UINT32_MAX */
+#include <cstring> /* strerror */
+#include <new>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#define SHARED_MEMORY_NAME_PREFIX "/us_lab4a_test_server-"
+#define DATA_ALIGNMENT 4096
+
+
+
+namespace Lab {
+
+namespace {
+
+// The futex word must be a plain 32-bit integer.
+static_assert(sizeof(std::atomic<boost::uint32_t>) == sizeof(boost::uint32_t), "Invalid atomic size.");
+
+std::atomic<unsigned int> nameCounter;
+
+}
+
+SharedMemoryRing::SharedMemoryRing(std::size_t numSlots, std::size_t slotSize)
+		: mappingSize_()
+		, mapping_(MAP_FAILED)
+		, header_()
+		, data_()
+		, writeCount_()
+{
+	if (numSlots == 0 || numSlots > UINT32_MAX) {
+		THROW_EXCEPTION(InvalidParameterException, "Invalid number of slots: " << numSlots << '.');
+	}
+	if (slotSize == 0 || slotSize > UINT32_MAX) {
+		THROW_EXCEPTION(InvalidParameterException, "Invalid slot size: " << slotSize << '.');
+	}
+
+	name_ = SHARED_MEMORY_NAME_PREFIX + std::to_string(getpid()) + '-' + std::to_string(nameCounter++);
+
+	const std::size_t dataOffset = (sizeof(SharedMemoryRingHeader) + DATA_ALIGNMENT - 1) / DATA_ALIGNMENT * DATA_ALIGNMENT;
+	mappingSize_ = dataOffset + numSlots * slotSize;
+
+	const int fd = shm_open(name_.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+	if (fd == -1) {
+		THROW_EXCEPTION(SharedMemoryException, "Could not create the shared memory object " << name_ << ": " << strerror(errno));
+	}
+	if (ftruncate(fd, mappingSize_) == -1) {
+		const int error = errno;
+		close(fd);
+		shm_unlink(name_.c_str());
+		THROW_EXCEPTION(SharedMemoryException, "Could not set the size of the shared memory object " << name_ << ": " << strerror(error));
+	}
+	mapping_ = mmap(nullptr, mappingSize_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	const int error = errno;
+	close(fd);
+	if (mapping_ == MAP_FAILED) {
+		shm_unlink(name_.c_str());
+		THROW_EXCEPTION(SharedMemoryException, "Could not map the shared memory object " << name_ << ": " << strerror(error));
+	}
+
+	header_ = new (mapping_) SharedMemoryRingHeader;
+	header_->magic = SharedMemoryRingHeader::MAGIC;
+	header_->version = SharedMemoryRingHeader::VERSION;
+	header_->numSlots = numSlots;
+	header_->slotSize = slotSize;
+	header_->dataOffset = dataOffset;
+	header_->writeCount.store(0, std::memory_order_relaxed);
+	header_->waiters.store(0, std::memory_order_relaxed);
+	header_->readCount.store(0, std::memory_order_release);
+	data_ = static_cast<boost::uint8_t*>(mapping_) + dataOffset;
+}
+
+SharedMemoryRing::~SharedMemoryRing()
+{
+	munmap(mapping_, mappingSize_);
+	shm_unlink(name_.c_str());
+}
+
+boost::uint8_t*
+SharedMemoryRing::beginWrite()
+{
+	const boost::uint32_t readCount = header_->readCount.load(std::memory_order_acquire);
+	if (writeCount_ - readCount >= header_->numSlots) {
+		return nullptr;
+	}
+	return data_ + static_cast<std::size_t>(writeSlot()) * header_->slotSize;
+}
+
+void
+SharedMemoryRing::endWrite()
+{
+	++writeCount_;
+	header_->writeCount.store(writeCount_, std::memory_order_seq_cst);
+	if (header_->waiters.load(std::memory_order_seq_cst) > 0) {
+		// Not FUTEX_PRIVATE_FLAG: the waiters are in other processes.
+		syscall(SYS_futex, &header_->writeCount, FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+	}
+}
+
+} // namespace Lab
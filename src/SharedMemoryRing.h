@@ -0,0 +1,109 @@
+/*
+
+  Copyright (c) 2013, 2017, 2018, 2019 Marcelo Y. Matuda.
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice,
+       this list of conditions and the following disclaimer.
+    2. Redistributions in binary form must reproduce the above copyright
+       notice, this list of conditions and the following disclaimer in the
+       documentation and/or other materials provided with the distribution.
+    3. Neither the name of the copyright holder nor the names of its
+       contributors may be used to endorse or promote products derived from
+       this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+  OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+  WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+  OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+  ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#ifndef SHAREDMEMORYRING_H_
+#define SHAREDMEMORYRING_H_
+
+#include <atomic>
+#include <cstddef> /* std::size_t */
+#include <string>
+
+#include <boost/cstdint.hpp>
+
+#include "Exception.h"
+
+
+
+namespace Lab {
+
+struct SharedMemoryException : public virtual Exception {};
+
+/*******************************************************************************
+ * Ring of fixed-size frame slots in POSIX shared memory.
+ *
+ * The server is the only writer. The client maps the object (shm_open +
+ * mmap), reads slot (readCount % numSlots) while readCount < writeCount,
+ * then increments readCount. The client may wait for new frames with
+ * FUTEX_WAIT on writeCount, after incrementing waiters.
+ *
+ * Layout: SharedMemoryRingHeader, followed by numSlots slots of slotSize
+ * bytes, starting at dataOffset.
+ */
+struct SharedMemoryRingHeader {
+	enum {
+		MAGIC = 0x55534C34, // "USL4"
+		VERSION = 1
+	};
+
+	boost::uint32_t magic;
+	boost::uint32_t version;
+	boost::uint32_t numSlots;
+	boost::uint32_t slotSize;
+	boost::uint32_t dataOffset;
+
+	alignas(64) std::atomic<boost::uint32_t> writeCount; // futex word
+	std::atomic<boost::uint32_t> waiters;
+
+	alignas(64) std::atomic<boost::uint32_t> readCount;
+};
+
+class SharedMemoryRing {
+public:
+	SharedMemoryRing(std::size_t numSlots, std::size_t slotSize);
+	~SharedMemoryRing();
+
+	// Returns a pointer to the next free slot, or nullptr if the ring is full.
+	boost::uint8_t* beginWrite();
+	// Publishes the slot returned by beginWrite() and wakes up the waiting readers.
+	void endWrite();
+
+	const std::string& name() const { return name_; }
+	boost::uint32_t numSlots() const { return header_->numSlots; }
+	boost::uint32_t slotSize() const { return header_->slotSize; }
+	// Index of the slot returned by beginWrite().
+	boost::uint32_t writeSlot() const { return writeCount_ % header_->numSlots; }
+	// Sequence number of the frame in the slot returned by beginWrite().
+	boost::uint32_t writeCount() const { return writeCount_; }
+private:
+	SharedMemoryRing(const SharedMemoryRing&) = delete;
+	SharedMemoryRing& operator=(const SharedMemoryRing&) = delete;
+
+	std::string name_;
+	std::size_t mappingSize_;
+	void* mapping_;
+	SharedMemoryRingHeader* header_;
+	boost::uint8_t* data_;
+	boost::uint32_t writeCount_;
+};
+
+} // namespace Lab
+
+#endif /* SHAREDMEMORYRING_H_ */
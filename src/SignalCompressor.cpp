@@ -0,0 +1,195 @@
+/*
+
+  Copyright (c) 2013, 2017, 2018, 2019 Marcelo Y. Matuda.
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice,
+       this list of conditions and the following disclaimer.
+    2. Redistributions in binary form must reproduce the above copyright
+       notice, this list of conditions and the following disclaimer in the
+       documentation and/or other materials provided with the distribution.
+    3. Neither the name of the copyright holder nor the names of its
+       contributors may be used to endorse or promote products derived from
+       this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+  OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+  WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+  OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+  ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "SignalCompressor.h"
+
+#include <algorithm> /* std::min */
+#include <atomic>
+#include <memory>
+#include <mutex>
+
+extern "C" {
+#include "lzf.h"
+}
+
+
+
+namespace Lab {
+
+/*******************************************************************************
+ * Blocks shared with the helper tasks.
+ *
+ * A helper that starts after all the blocks have been taken does nothing.
+ */
+struct SignalCompressor::Job {
+	Block* blockList;
+	std::size_t numBlocks;
+	std::atomic<std::size_t> nextBlock;
+	std::mutex mutex;
+	std::size_t numFinishedBlocks; // protected by mutex
+	const std::function<void()>* completion; // called by a helper that finishes the job
+};
+
+SignalCompressor::SignalCompressor()
+		: numHelpers_()
+		, numSamples_()
+		, numBlocks_()
+{
+}
+
+SignalCompressor::~SignalCompressor()
+{
+}
+
+void
+SignalCompressor::setExecutor(Executor executor, unsigned int numHelpers, std::function<void()> completion)
+{
+	executor_ = std::move(executor);
+	numHelpers_ = executor_ ? numHelpers : 0;
+	completion_ = std::move(completion);
+}
+
+std::size_t
+SignalCompressor::bufferCapacity() const
+{
+	std::size_t capacity = blockList_.capacity() * sizeof(Block);
+	for (const Block& block : blockList_) {
+		capacity += block.deltaBuffer.capacity() + block.encodedBuffer.capacity();
+	}
+	return capacity;
+}
+
+std::size_t
+SignalCompressor::requiredBufferCapacity(std::size_t numSamples, std::size_t blockSize)
+{
+	if (blockSize == 0 || blockSize > numSamples || numSamples % blockSize != 0) {
+		blockSize = numSamples;
+	}
+	const std::size_t numBlocks = (numSamples > 0) ? numSamples / blockSize : 0;
+	return numBlocks * sizeof(Block) + 2 * numSamples * sizeof(boost::int16_t);
+}
+
+bool
+SignalCompressor::compress(const boost::uint8_t* signal, std::size_t numSamples, std::size_t blockSize,
+				RawBuffer::ByteOrder byteOrder)
+{
+	if (blockSize == 0 || blockSize > numSamples || numSamples % blockSize != 0) {
+		blockSize = numSamples;
+	}
+	const std::size_t numBlocks = (numSamples > 0) ? numSamples / blockSize : 0;
+
+	if (blockList_.size() < numBlocks) blockList_.resize(numBlocks);
+	for (std::size_t i = 0; i < numBlocks; ++i) {
+		blockList_[i].signal = signal + i * blockSize * sizeof(boost::int16_t);
+		blockList_[i].numSamples = blockSize;
+		blockList_[i].byteOrder = byteOrder;
+	}
+	numSamples_ = numSamples;
+	numBlocks_ = numBlocks;
+	if (numBlocks == 0) return true;
+
+	// The job is reused if no helper task holds it.
+	if (!job_ || job_.use_count() > 1) job_ = std::make_shared<Job>();
+	const std::shared_ptr<Job> job = job_;
+	job->blockList = blockList_.data();
+	job->numBlocks = numBlocks;
+	job->nextBlock = 0;
+	job->numFinishedBlocks = 0;
+	job->completion = &completion_;
+
+	const unsigned int numHelpers = std::min<std::size_t>(numHelpers_, numBlocks - 1);
+	for (unsigned int i = 0; i < numHelpers; ++i) {
+		executor_([job]() {
+			if (runJob(*job)) (*job->completion)();
+		});
+	}
+	return runJob(*job);
+}
+
+void
+SignalCompressor::putEncodedSignal(RawBuffer& rawBuffer) const
+{
+	rawBuffer.putUInt32(numSamples_);
+	rawBuffer.putUInt32(numBlocks_);
+	for (std::size_t i = 0; i < numBlocks_; ++i) {
+		const Block& block = blockList_[i];
+		rawBuffer.putUInt32(block.numSamples);
+		rawBuffer.putUInt32(block.encodedSize);
+		std::copy(block.encodedBuffer.begin(), block.encodedBuffer.begin() + block.encodedSize,
+				rawBuffer.putSpace(block.encodedSize));
+	}
+}
+
+/*******************************************************************************
+ * Returns true if the caller has encoded the last block of the job.
+ */
+bool
+SignalCompressor::runJob(Job& job)
+{
+	std::size_t numBlocks = 0;
+	for (;;) {
+		const std::size_t i = job.nextBlock++;
+		if (i >= job.numBlocks) break;
+		encodeBlock(job.blockList[i]);
+		++numBlocks;
+	}
+	if (numBlocks == 0) return false;
+
+	std::lock_guard<std::mutex> locker(job.mutex);
+	job.numFinishedBlocks += numBlocks;
+	return job.numFinishedBlocks == job.numBlocks;
+}
+
+void
+SignalCompressor::encodeBlock(Block& block)
+{
+	const std::size_t size = block.numSamples * sizeof(boost::int16_t);
+	block.deltaBuffer.resize(size);
+	block.encodedBuffer.resize(size);
+
+	const boost::uint8_t* src = block.signal;
+	boost::uint8_t* dest = block.deltaBuffer.data();
+	boost::uint16_t prevValue = 0;
+	for (std::size_t i = 0; i < block.numSamples; ++i, src += 2, dest += 2) {
+		const boost::uint16_t value = static_cast<boost::uint16_t>(RawBuffer::loadInt16(src, block.byteOrder));
+		RawBuffer::storeInt16(static_cast<boost::int16_t>(value - prevValue), dest, block.byteOrder);
+		prevValue = value;
+	}
+
+	// Require some gain, otherwise store the deltas.
+	block.encodedSize = (size > 1) ? lzf_compress(block.deltaBuffer.data(), size, block.encodedBuffer.data(), size - 1) : 0;
+	if (block.encodedSize == 0) {
+		block.deltaBuffer.swap(block.encodedBuffer);
+		block.encodedSize = size;
+	}
+}
+
+} // namespace Lab
@@ -0,0 +1,124 @@
+/*
+
+  Copyright (c) 2013, 2017, 2018, 2019 Marcelo Y. Matuda.
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice,
+       this list of conditions and the following disclaimer.
+    2. Redistributions in binary form must reproduce the above copyright
+       notice, this list of conditions and the following disclaimer in the
+       documentation and/or other materials provided with the distribution.
+    3. Neither the name of the copyright holder nor the names of its
+       contributors may be used to endorse or promote products derived from
+       this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+  OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+  WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+  OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+  ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#ifndef SIGNALCOMPRESSOR_H_
+#define SIGNALCOMPRESSOR_H_
+
+#include <cstddef> /* std::size_t */
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include <boost/cstdint.hpp>
+
+#include "RawBuffer.h"
+
+
+
+namespace Lab {
+
+/*******************************************************************************
+ * Compresses int16 signals for the wire.
+ *
+ * The signal is split in blocks (one block per channel), and each block is
+ * compressed independently:
+ *   - delta coding: d[0] = x[0], d[i] = x[i] - x[i - 1] (modulo 2^16);
+ *   - the int16 deltas (in the byte order of the RawBuffer) are compressed with LZF.
+ *
+ * Encoded signal:
+ *     uint32 number of samples
+ *     uint32 number of blocks
+ *     for each block:
+ *         uint32 number of samples
+ *         uint32 encoded size
+ *         encoded data
+ * If the encoded size is equal to 2 * (number of samples), the deltas are
+ * stored without LZF compression.
+ *
+ * If an executor is set, helper tasks are posted to compress some of the
+ * blocks in other threads. compress() never waits for the helpers: if a
+ * helper encodes the last block, it calls the completion function in its
+ * thread. A helper that starts after all the blocks have been taken does
+ * nothing.
+ */
+class SignalCompressor {
+public:
+	typedef std::function<void(std::function<void()>)> Executor;
+
+	SignalCompressor();
+	~SignalCompressor();
+
+	// completion is called by the helper that encodes the last block, if
+	// compress() has returned false.
+	void setExecutor(Executor executor, unsigned int numHelpers, std::function<void()> completion);
+
+	// signal: int16 samples, in byteOrder. It must not change until the
+	// blocks are encoded.
+	// Returns true if all the blocks have been encoded, otherwise the
+	// completion function will be called. Then putEncodedSignal() may be called.
+	bool compress(const boost::uint8_t* signal, std::size_t numSamples, std::size_t blockSize,
+			RawBuffer::ByteOrder byteOrder);
+	// Appends the encoded signal to rawBuffer.
+	void putEncodedSignal(RawBuffer& rawBuffer) const;
+
+	// Bytes allocated by the block buffers.
+	std::size_t bufferCapacity() const;
+	// Bytes that the block buffers will allocate to compress numSamples samples.
+	static std::size_t requiredBufferCapacity(std::size_t numSamples, std::size_t blockSize);
+private:
+	struct Block {
+		const boost::uint8_t* signal;
+		std::size_t numSamples;
+		RawBuffer::ByteOrder byteOrder;
+		std::vector<boost::uint8_t> deltaBuffer;
+		std::vector<boost::uint8_t> encodedBuffer;
+		std::size_t encodedSize;
+	};
+	struct Job;
+
+	SignalCompressor(const SignalCompressor&) = delete;
+	SignalCompressor& operator=(const SignalCompressor&) = delete;
+
+	static void encodeBlock(Block& block);
+	static bool runJob(Job& job);
+
+	Executor executor_;
+	unsigned int numHelpers_;
+	std::function<void()> completion_;
+	std::size_t numSamples_; // of the last compress()
+	std::size_t numBlocks_;
+	std::vector<Block> blockList_;
+	std::shared_ptr<Job> job_;
+};
+
+} // namespace Lab
+
+#endif /* SIGNALCOMPRESSOR_H_ */
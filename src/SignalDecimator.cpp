@@ -0,0 +1,183 @@
+/*
+
+  Copyright (c) 2013, 2017, 2018, 2019 Marcelo Y. Matuda.
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice,
+       this list of conditions and the following disclaimer.
+    2. Redistributions in binary form must reproduce the above copyright
+       notice, this list of conditions and the following disclaimer in the
+       documentation and/or other materials provided with the distribution.
+    3. Neither the name of the copyright holder nor the names of its
+       contributors may be used to endorse or promote products derived from
+       this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+  OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+  WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+  OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+  ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "SignalDecimator.h"
+
+#include <algorithm> /* std::fill, std::max, std::min */
+#include <cmath>
+#include <cstring> /* memcpy */
+
+#ifdef __AVX__
+# include <immintrin.h>
+#elif defined(__SSE__)
+# include <xmmintrin.h>
+#endif
+
+#define COEFFICIENT_ALIGNMENT 8
+
+
+
+namespace Lab {
+
+namespace {
+
+// size must be a multiple of COEFFICIENT_ALIGNMENT.
+inline
+float
+dotProduct(const float* a, const float* b, std::size_t size)
+{
+	std::size_t i = 0;
+#ifdef __AVX__
+	__m256 sum = _mm256_setzero_ps();
+	for ( ; i < size; i += 8) {
+# ifdef __FMA__
+		sum = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), sum);
+# else
+		sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i)));
+# endif
+	}
+	__m128 sum4 = _mm_add_ps(_mm256_castps256_ps128(sum), _mm256_extractf128_ps(sum, 1));
+	sum4 = _mm_add_ps(sum4, _mm_movehl_ps(sum4, sum4));
+	sum4 = _mm_add_ss(sum4, _mm_shuffle_ps(sum4, sum4, 1));
+	return _mm_cvtss_f32(sum4);
+#elif defined(__SSE__)
+	__m128 sum0 = _mm_setzero_ps();
+	__m128 sum1 = _mm_setzero_ps();
+	for ( ; i < size; i += 8) {
+		sum0 = _mm_add_ps(sum0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+		sum1 = _mm_add_ps(sum1, _mm_mul_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4)));
+	}
+	__m128 sum4 = _mm_add_ps(sum0, sum1);
+	sum4 = _mm_add_ps(sum4, _mm_movehl_ps(sum4, sum4));
+	sum4 = _mm_add_ss(sum4, _mm_shuffle_ps(sum4, sum4, 1));
+	return _mm_cvtss_f32(sum4);
+#else
+	float sum = 0.0f;
+	for ( ; i < size; ++i) {
+		sum += a[i] * b[i];
+	}
+	return sum;
+#endif
+}
+
+}
+
+SignalDecimator::SignalDecimator()
+		: factor_(1)
+		, delay_()
+{
+}
+
+SignalDecimator::~SignalDecimator()
+{
+}
+
+void
+SignalDecimator::setFactor(unsigned int factor)
+{
+	if (factor == 0) {
+		THROW_EXCEPTION(InvalidParameterException, "Invalid decimation factor: " << factor << '.');
+	}
+	factor_ = factor;
+	if (factor_ == 1) {
+		delay_ = 0;
+		coefficients_.clear();
+		return;
+	}
+
+	const std::size_t numTaps = TAPS_PER_FACTOR * factor_ + 1;
+	delay_ = (numTaps - 1) / 2;
+	coefficients_.assign((numTaps + COEFFICIENT_ALIGNMENT - 1) / COEFFICIENT_ALIGNMENT * COEFFICIENT_ALIGNMENT, 0.0f);
+
+	const double pi = std::acos(-1.0);
+	const double fc = 0.5 / factor_; // normalized cutoff frequency
+	double sum = 0.0;
+	for (std::size_t i = 0; i < numTaps; ++i) {
+		const double t = static_cast<double>(i) - static_cast<double>(delay_);
+		const double sinc = (t == 0.0) ? 2.0 * fc : std::sin(2.0 * pi * fc * t) / (pi * t);
+		const double x = 2.0 * pi * i / (numTaps - 1);
+		const double window = 0.42 - 0.5 * std::cos(x) + 0.08 * std::cos(2.0 * x);
+		const double c = sinc * window;
+		coefficients_[i] = static_cast<float>(c);
+		sum += c;
+	}
+	// Unity gain at DC.
+	for (std::size_t i = 0; i < numTaps; ++i) {
+		coefficients_[i] = static_cast<float>(coefficients_[i] / sum);
+	}
+}
+
+std::size_t
+SignalDecimator::channelBufferSize(std::size_t signalLength) const
+{
+	const std::size_t outLength = outputLength(signalLength);
+	if (factor_ == 1 || outLength == 0) return 0;
+	return std::max(delay_ + signalLength, (outLength - 1) * factor_ + coefficients_.size());
+}
+
+std::size_t
+SignalDecimator::requiredBufferCapacity(std::size_t signalLength) const
+{
+	return (coefficients_.capacity() + channelBufferSize(signalLength)) * sizeof(float);
+}
+
+void
+SignalDecimator::decimate(const boost::uint8_t* signal, std::size_t numChannels, std::size_t signalLength,
+				RawBuffer::ByteOrder byteOrder, boost::uint8_t* dest)
+{
+	if (factor_ == 1) {
+		std::memcpy(dest, signal, numChannels * signalLength * sizeof(boost::int16_t));
+		return;
+	}
+
+	const std::size_t outLength = outputLength(signalLength);
+	if (outLength == 0) return;
+	const std::size_t numCoefficients = coefficients_.size();
+	// channelBuffer_[delay_ + i] = x[i]
+	channelBuffer_.resize(channelBufferSize(signalLength));
+	std::fill(channelBuffer_.begin(), channelBuffer_.begin() + delay_, 0.0f);
+	std::fill(channelBuffer_.begin() + delay_ + signalLength, channelBuffer_.end(), 0.0f);
+
+	for (std::size_t channel = 0; channel < numChannels; ++channel) {
+		float* x = channelBuffer_.data() + delay_;
+		for (std::size_t i = 0; i < signalLength; ++i, signal += sizeof(boost::int16_t)) {
+			x[i] = RawBuffer::loadInt16(signal, byteOrder);
+		}
+
+		const float* window = channelBuffer_.data();
+		for (std::size_t m = 0; m < outLength; ++m, window += factor_, dest += sizeof(boost::int16_t)) {
+			const float y = std::round(dotProduct(coefficients_.data(), window, numCoefficients));
+			RawBuffer::storeInt16(static_cast<boost::int16_t>(std::min(std::max(y, -32768.0f), 32767.0f)), dest, byteOrder);
+		}
+	}
+}
+
+} // namespace Lab
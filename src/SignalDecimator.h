@@ -0,0 +1,95 @@
+/*
+
+  Copyright (c) 2013, 2017, 2018, 2019 Marcelo Y. Matuda.
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice,
+       this list of conditions and the following disclaimer.
+    2. Redistributions in binary form must reproduce the above copyright
+       notice, this list of conditions and the following disclaimer in the
+       documentation and/or other materials provided with the distribution.
+    3. Neither the name of the copyright holder nor the names of its
+       contributors may be used to endorse or promote products derived from
+       this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+  OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+  WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+  OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+  ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#ifndef SIGNALDECIMATOR_H_
+#define SIGNALDECIMATOR_H_
+
+#include <cstddef> /* std::size_t */
+#include <vector>
+
+#include <boost/cstdint.hpp>
+
+#include "RawBuffer.h"
+
+
+
+namespace Lab {
+
+/*******************************************************************************
+ * Low-pass filters and decimates int16 signals by an integer factor.
+ *
+ * The filter is a linear-phase windowed-sinc FIR (Blackman window), with
+ * cutoff at 0.5 / factor of the sampling frequency and TAPS_PER_FACTOR *
+ * factor + 1 coefficients. The group delay is compensated, and the signal
+ * is extended with zeros at both ends.
+ *
+ * Only the output samples are computed (polyphase decimation): the output
+ * sample m of a channel is the dot product of the coefficients with the
+ * input samples around m * factor. The cost per output sample is fixed.
+ */
+class SignalDecimator {
+public:
+	enum {
+		TAPS_PER_FACTOR = 16
+	};
+
+	SignalDecimator();
+	~SignalDecimator();
+
+	// 1: no filtering.
+	void setFactor(unsigned int factor);
+	unsigned int factor() const { return factor_; }
+	std::size_t outputLength(std::size_t signalLength) const { return (signalLength + factor_ - 1) / factor_; }
+
+	// signal: numChannels * signalLength int16 samples, in byteOrder.
+	// Writes numChannels * outputLength(signalLength) int16 samples to dest, in byteOrder.
+	void decimate(const boost::uint8_t* signal, std::size_t numChannels, std::size_t signalLength,
+			RawBuffer::ByteOrder byteOrder, boost::uint8_t* dest);
+
+	// Bytes allocated by the coefficients and the channel buffer.
+	std::size_t bufferCapacity() const { return (coefficients_.capacity() + channelBuffer_.capacity()) * sizeof(float); }
+	// Bytes that they will allocate to decimate signals of signalLength samples.
+	std::size_t requiredBufferCapacity(std::size_t signalLength) const;
+private:
+	std::size_t channelBufferSize(std::size_t signalLength) const;
+
+	SignalDecimator(const SignalDecimator&) = delete;
+	SignalDecimator& operator=(const SignalDecimator&) = delete;
+
+	unsigned int factor_;
+	std::size_t delay_; // samples
+	std::vector<float> coefficients_; // padded with zeros to a multiple of 8
+	std::vector<float> channelBuffer_; // zero-extended input of one channel
+};
+
+} // namespace Lab
+
+#endif /* SIGNALDECIMATOR_H_ */
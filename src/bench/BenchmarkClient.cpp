@@ -0,0 +1,331 @@
+/*
+
+  Copyright (c) 2013, 2017, 2018, 2019 Marcelo Y. Matuda.
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice,
+       this list of conditions and the following disclaimer.
+    2. Redistributions in binary form must reproduce the above copyright
+       notice, this list of conditions and the following disclaimer in the
+       documentation and/or other materials provided with the distribution.
+    3. Neither the name of the copyright holder nor the names of its
+       contributors may be used to endorse or promote products derived from
+       this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+  OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+  WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+  OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+  ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "BenchmarkClient.h"
+
+#include <boost/asio/connect.hpp>
+#include <boost/asio/write.hpp>
+
+#include "Exception.h"
+
+
+
+namespace Lab {
+
+namespace {
+
+const char* requestKindNames[] = {
+	"signal",
+	"batch",
+	"region",
+	"config",
+	"length",
+	"stream"
+};
+
+} // namespace
+
+void
+BenchmarkClient::KindResult::add(const KindResult& other)
+{
+	requests += other.requests;
+	frames   += other.frames;
+	errors   += other.errors;
+	bytes    += other.bytes;
+	latency.add(other.latency);
+}
+
+BenchmarkClient::BenchmarkClient(boost::asio::io_context& ioContext, const BenchmarkConfiguration& config, unsigned int seed)
+		: config_(config)
+		, socket_(ioContext)
+		, prng_(seed)
+		, requestDist_(config.mixWeights.begin(), config.mixWeights.end())
+		, signalLength_()
+{
+}
+
+BenchmarkClient::~BenchmarkClient()
+{
+}
+
+const char*
+BenchmarkClient::requestKindName(int kind)
+{
+	if (kind < 0 || kind >= NUM_REQUEST_KINDS) return "?";
+	return requestKindNames[kind];
+}
+
+int
+BenchmarkClient::requestKind(const std::string& name)
+{
+	for (int kind = 0; kind < NUM_REQUEST_KINDS; ++kind) {
+		if (name == requestKindNames[kind]) return kind;
+	}
+	return NUM_REQUEST_KINDS;
+}
+
+/*******************************************************************************
+ * Connects and negotiates the options. Gets the signal length.
+ */
+void
+BenchmarkClient::connect()
+{
+	boost::asio::ip::tcp::resolver resolver(socket_.get_executor());
+	boost::asio::connect(socket_, resolver.resolve(config_.host, std::to_string(config_.port)));
+	socket_.set_option(boost::asio::ip::tcp::no_delay(true));
+
+	prepareMessage(CONNECT_REQUEST);
+	dataRawBuffer_.putUInt32(PROTOCOL_VERSION);
+	if (config_.connectOptions != 0) {
+		dataRawBuffer_.putUInt32(config_.connectOptions);
+	}
+	sendMessage();
+	flush();
+	if (config_.connectOptions != 0) {
+		checkResponse(receive(), CONNECT_RESPONSE);
+		const boost::uint32_t acceptedOptions = dataRawBuffer_.getUInt32();
+		if (acceptedOptions & CONNECT_OPTION_LITTLE_ENDIAN) {
+			dataRawBuffer_.setByteOrder(RawBuffer::BYTE_ORDER_LITTLE_ENDIAN);
+		}
+	} else {
+		checkResponse(receive(), OK_RESPONSE);
+	}
+
+	prepareMessage(GET_SIGNAL_LENGTH_REQUEST);
+	sendMessage();
+	flush();
+	checkResponse(receive(), GET_SIGNAL_LENGTH_RESPONSE);
+	signalLength_ = dataRawBuffer_.getUInt32();
+}
+
+void
+BenchmarkClient::run(Clock::time_point endTime)
+{
+	if (config_.stream) {
+		runStream(endTime);
+	} else {
+		runMix(endTime);
+	}
+}
+
+void
+BenchmarkClient::disconnect()
+{
+	prepareMessage(DISCONNECT_REQUEST);
+	sendMessage();
+	flush();
+	boost::system::error_code ec;
+	socket_.shutdown(boost::asio::ip::tcp::socket::shutdown_both, ec);
+	socket_.close(ec);
+}
+
+/*******************************************************************************
+ * The responses of protocol 1006 are received in the order of the requests.
+ */
+void
+BenchmarkClient::runMix(Clock::time_point endTime)
+{
+	for (;;) {
+		if (Clock::now() < endTime) {
+			const std::size_t firstNewRequest = pendingRequests_.size();
+			while (pendingRequests_.size() < config_.pipelineDepth) {
+				const RequestKind kind = chooseRequest();
+				prepareRequest(kind);
+				sendMessage();
+				pendingRequests_.push_back(PendingRequest{kind, Clock::time_point()});
+			}
+			flush();
+			const Clock::time_point sendTime = Clock::now();
+			for (std::size_t i = firstNewRequest; i < pendingRequests_.size(); ++i) {
+				pendingRequests_[i].sendTime = sendTime;
+			}
+		}
+		if (pendingRequests_.empty()) break;
+
+		const boost::uint32_t messageType = receive();
+		const Clock::time_point receiveTime = Clock::now();
+		const PendingRequest request = pendingRequests_.front();
+		pendingRequests_.pop_front();
+
+		KindResult& r = result_[request.kind];
+		r.bytes += HEADER_RAW_BUFFER_SIZE + dataRawBuffer_.size();
+		if (messageType == ERROR_RESPONSE) {
+			++r.errors;
+			continue;
+		}
+		++r.requests;
+		r.latency.record(std::chrono::duration_cast<std::chrono::nanoseconds>(receiveTime - request.sendTime).count());
+		switch (request.kind) {
+		case REQUEST_SIGNAL: // falls through
+		case REQUEST_REGION:
+			++r.frames;
+			break;
+		case REQUEST_BATCH:
+			r.frames += config_.batchFrames;
+			break;
+		default:
+			break;
+		}
+	}
+}
+
+/*******************************************************************************
+ * The stream is stopped at endTime.
+ */
+void
+BenchmarkClient::runStream(Clock::time_point endTime)
+{
+	KindResult& r = result_[REQUEST_STREAM];
+
+	prepareMessage(START_STREAM_REQUEST);
+	dataRawBuffer_.putFloat(config_.streamFrameRate);
+	sendMessage();
+	flush();
+	checkResponse(receive(), OK_RESPONSE);
+
+	Clock::time_point lastFrameTime = Clock::now();
+	bool stopped = false;
+	for (;;) {
+		if (!stopped && Clock::now() >= endTime) {
+			prepareMessage(STOP_STREAM_REQUEST);
+			sendMessage();
+			flush();
+			stopped = true;
+		}
+
+		const boost::uint32_t messageType = receive();
+		const Clock::time_point receiveTime = Clock::now();
+		r.bytes += HEADER_RAW_BUFFER_SIZE + dataRawBuffer_.size();
+		if (messageType == OK_RESPONSE && stopped) break;
+		if (messageType == ERROR_RESPONSE) {
+			++r.errors;
+			continue;
+		}
+		++r.requests;
+		++r.frames;
+		r.latency.record(std::chrono::duration_cast<std::chrono::nanoseconds>(receiveTime - lastFrameTime).count());
+		lastFrameTime = receiveTime;
+	}
+}
+
+BenchmarkClient::RequestKind
+BenchmarkClient::chooseRequest()
+{
+	return static_cast<RequestKind>(requestDist_(prng_));
+}
+
+void
+BenchmarkClient::prepareRequest(RequestKind kind)
+{
+	switch (kind) {
+	case REQUEST_SIGNAL:
+		prepareMessage(GET_SIGNAL_REQUEST);
+		break;
+	case REQUEST_BATCH:
+		prepareMessage(GET_SIGNAL_BATCH_REQUEST);
+		dataRawBuffer_.putUInt32(config_.batchFrames);
+		break;
+	case REQUEST_REGION:
+		prepareMessage(GET_SIGNAL_REGION_REQUEST);
+		dataRawBuffer_.putString(std::string()); // all the channels
+		dataRawBuffer_.putUInt32(0);
+		dataRawBuffer_.putUInt32(signalLength_ / 4);
+		break;
+	case REQUEST_CONFIG:
+		{
+			// A typical configuration sequence, applied at once.
+			const std::vector<float> delays(64, 0.0f);
+			prepareMessage(SET_CONFIGURATION_REQUEST);
+			dataRawBuffer_.putUInt32(5); // number of items
+			dataRawBuffer_.putUInt32(EXEC_PRE_CONFIGURATION_REQUEST);
+			dataRawBuffer_.putUInt32(0);
+			dataRawBuffer_.putUInt32(SET_CENTER_FREQUENCY_REQUEST);
+			dataRawBuffer_.putUInt32(8);
+			dataRawBuffer_.putFloat(5.0e6f);
+			dataRawBuffer_.putUInt32(1);
+			dataRawBuffer_.putUInt32(SET_GAIN_REQUEST);
+			dataRawBuffer_.putUInt32(4);
+			dataRawBuffer_.putFloat(20.0f);
+			dataRawBuffer_.putUInt32(SET_RECEIVE_DELAYS_REQUEST);
+			dataRawBuffer_.putUInt32(4 + delays.size() * sizeof(float));
+			dataRawBuffer_.putFloatArray(delays);
+			dataRawBuffer_.putUInt32(EXEC_POST_CONFIGURATION_REQUEST);
+			dataRawBuffer_.putUInt32(0);
+		}
+		break;
+	case REQUEST_LENGTH: // falls through
+	default:
+		prepareMessage(GET_SIGNAL_LENGTH_REQUEST);
+		break;
+	}
+}
+
+/*******************************************************************************
+ * Writes the output queue.
+ */
+void
+BenchmarkClient::flush()
+{
+	while (outputPending()) {
+		getOutputBuffers(writeBuffers_);
+		boost::asio::write(socket_, writeBuffers_);
+		outputSent();
+	}
+}
+
+/*******************************************************************************
+ * Blocks until a complete message is received. The data are placed in dataRawBuffer_.
+ */
+boost::uint32_t
+BenchmarkClient::receive()
+{
+	boost::uint32_t messageType;
+	while (!receiveMessage(messageType)) {
+		const std::size_t size = socket_.read_some(inputBuffer());
+		inputReceived(size);
+	}
+	return messageType;
+}
+
+void
+BenchmarkClient::checkResponse(boost::uint32_t messageType, boost::uint32_t expectedType)
+{
+	if (messageType == ERROR_RESPONSE) {
+		std::string message;
+		dataRawBuffer_.getString(message);
+		THROW_EXCEPTION(ServerException, "Error response: " << message);
+	}
+	if (messageType != expectedType) {
+		THROW_EXCEPTION(InvalidMessageTypeException, "Unexpected message type: " << messageType << '.');
+	}
+}
+
+} // namespace Lab
@@ -0,0 +1,157 @@
+/*
+
+  Copyright (c) 2013, 2017, 2018, 2019 Marcelo Y. Matuda.
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice,
+       this list of conditions and the following disclaimer.
+    2. Redistributions in binary form must reproduce the above copyright
+       notice, this list of conditions and the following disclaimer in the
+       documentation and/or other materials provided with the distribution.
+    3. Neither the name of the copyright holder nor the names of its
+       contributors may be used to endorse or promote products derived from
+       this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+  OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+  WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+  OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+  ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#ifndef BENCHMARKCLIENT_H_
+#define BENCHMARKCLIENT_H_
+
+#include <array>
+#include <cstddef> /* std::size_t */
+#include <deque>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <boost/asio/buffer.hpp>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/cstdint.hpp>
+
+#include "ArrayAcqProtocol.h"
+#include "LatencyHistogram.h"
+
+
+
+namespace Lab {
+
+/*******************************************************************************
+ * Benchmark parameters, from the command line.
+ */
+struct BenchmarkConfiguration {
+	BenchmarkConfiguration()
+			: port()
+			, numConnections(1)
+			, duration(10.0)
+			, pipelineDepth(1)
+			, batchFrames(8)
+			, connectOptions()
+			, stream()
+			, streamFrameRate()
+	{}
+
+	std::string host;
+	unsigned short port;
+	unsigned int numConnections;
+	double duration; // s
+	unsigned int pipelineDepth; // requests in flight per connection
+	unsigned int batchFrames; // per GET_SIGNAL_BATCH_REQUEST
+	boost::uint32_t connectOptions; // ConnectOption bit mask
+	bool stream; // START_STREAM_REQUEST instead of the request mix
+	float streamFrameRate; // Hz, 0: as fast as possible
+	std::vector<unsigned int> mixWeights; // indexed by BenchmarkClient::RequestKind
+};
+
+/*******************************************************************************
+ * A client connection of the benchmark, using protocol version 1006.
+ *
+ * The requests of the mix are chosen at random, with the configured
+ * weights, and up to pipelineDepth requests are in flight. The latency of
+ * a request is the time between its write and the reception of the whole
+ * response. In stream mode, the latency is the interval between frames.
+ *
+ * The socket is blocking: each client runs in its own thread.
+ */
+class BenchmarkClient : private ArrayAcqProtocol {
+public:
+	typedef ArrayAcqProtocol::Clock Clock;
+
+	enum RequestKind {
+		REQUEST_SIGNAL, // GET_SIGNAL_REQUEST
+		REQUEST_BATCH,  // GET_SIGNAL_BATCH_REQUEST
+		REQUEST_REGION, // GET_SIGNAL_REGION_REQUEST, a quarter of the samples of all the channels
+		REQUEST_CONFIG, // SET_CONFIGURATION_REQUEST
+		REQUEST_LENGTH, // GET_SIGNAL_LENGTH_REQUEST
+		REQUEST_STREAM, // stream frames
+		NUM_REQUEST_KINDS
+	};
+
+	struct KindResult {
+		KindResult() : requests(), frames(), errors(), bytes() {}
+		void add(const KindResult& other);
+
+		boost::uint64_t requests; // successful
+		boost::uint64_t frames;
+		boost::uint64_t errors;
+		boost::uint64_t bytes; // received, including the headers
+		LatencyHistogram latency; // ns
+	};
+	typedef std::array<KindResult, NUM_REQUEST_KINDS> Result;
+
+	BenchmarkClient(boost::asio::io_context& ioContext, const BenchmarkConfiguration& config, unsigned int seed);
+	~BenchmarkClient();
+
+	void connect();
+	void run(Clock::time_point endTime);
+	void disconnect();
+	const Result& result() const { return result_; }
+
+	static const char* requestKindName(int kind);
+	// Returns NUM_REQUEST_KINDS if the name is invalid.
+	static int requestKind(const std::string& name);
+private:
+	struct PendingRequest {
+		RequestKind kind;
+		Clock::time_point sendTime;
+	};
+
+	BenchmarkClient(const BenchmarkClient&) = delete;
+	BenchmarkClient& operator=(const BenchmarkClient&) = delete;
+
+	void runMix(Clock::time_point endTime);
+	void runStream(Clock::time_point endTime);
+	RequestKind chooseRequest();
+	void prepareRequest(RequestKind kind);
+	void flush();
+	boost::uint32_t receive();
+	void checkResponse(boost::uint32_t messageType, boost::uint32_t expectedType);
+
+	const BenchmarkConfiguration& config_;
+	boost::asio::ip::tcp::socket socket_;
+	std::vector<boost::asio::const_buffer> writeBuffers_;
+	std::minstd_rand prng_;
+	std::discrete_distribution<int> requestDist_;
+	std::deque<PendingRequest> pendingRequests_;
+	boost::uint32_t signalLength_;
+	Result result_;
+};
+
+} // namespace Lab
+
+#endif /* BENCHMARKCLIENT_H_ */
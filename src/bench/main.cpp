@@ -0,0 +1,239 @@
+/*
+
+  Copyright (c) 2013, 2017, 2018, 2019 Marcelo Y. Matuda.
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice,
+       this list of conditions and the following disclaimer.
+    2. Redistributions in binary form must reproduce the above copyright
+       notice, this list of conditions and the following disclaimer in the
+       documentation and/or other materials provided with the distribution.
+    3. Neither the name of the copyright holder nor the names of its
+       contributors may be used to endorse or promote products derived from
+       this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+  OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+  WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+  OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+  ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <boost/asio/io_context.hpp>
+
+#include "BenchmarkClient.h"
+
+#define MAX_CONNECTIONS 4096
+#define MAX_PIPELINE_DEPTH 1024
+#define MAX_BATCH_FRAMES 1024
+
+namespace {
+
+void
+printUsage(const char* programName)
+{
+	std::cerr << "Usage: " << programName << " [options] host port\n"
+		"Options:\n"
+		"  --connections N   concurrent connections (default: 1)\n"
+		"  --duration S      seconds (default: 10)\n"
+		"  --mix KIND=W,...  request mix, with integer weights (default: signal=1)\n"
+		"                    KIND: signal, batch, region, config, length\n"
+		"  --pipeline N      requests in flight per connection (default: 1)\n"
+		"  --batch-frames N  frames per batch request (default: 8)\n"
+		"  --stream RATE     stream mode instead of the mix, frame rate in Hz\n"
+		"                    per connection (0: as fast as possible)\n"
+		"  --options MASK    options of CONNECT_REQUEST (default: 0)\n"
+		"  --output FILE     appends the CSV to FILE (default: standard output)\n"
+		"The CSV has one line per request kind, and one line with the totals." << std::endl;
+}
+
+template<typename T>
+bool
+parseValue(const char* s, T min, T max, T& value)
+{
+	std::istringstream in(s);
+	T v;
+	if (!(in >> v) || !in.eof() || v < min || v > max) return false;
+	value = v;
+	return true;
+}
+
+bool
+parseMix(const std::string& s, std::vector<unsigned int>& weights)
+{
+	weights.assign(Lab::BenchmarkClient::NUM_REQUEST_KINDS, 0);
+	std::istringstream in(s);
+	std::string item;
+	unsigned int total = 0;
+	while (std::getline(in, item, ',')) {
+		const std::size_t sep = item.find('=');
+		if (sep == std::string::npos) return false;
+		const int kind = Lab::BenchmarkClient::requestKind(item.substr(0, sep));
+		if (kind == Lab::BenchmarkClient::NUM_REQUEST_KINDS || kind == Lab::BenchmarkClient::REQUEST_STREAM) return false;
+		if (!parseValue(item.c_str() + sep + 1, 0U, 1000000U, weights[kind])) return false;
+		total += weights[kind];
+	}
+	return total > 0;
+}
+
+void
+writeCsvLine(std::ostream& out, const char* kind, const Lab::BenchmarkConfiguration& config, double elapsed,
+		const Lab::BenchmarkClient::KindResult& r)
+{
+	out << kind << ',' << config.numConnections << ',' << elapsed << ','
+		<< r.requests << ',' << r.frames << ',' << r.errors << ','
+		<< r.requests / elapsed << ',' << r.frames / elapsed << ',' << r.bytes / elapsed * 1.0e-6 << ','
+		<< r.latency.percentile(0.5) * 1.0e-3 << ','
+		<< r.latency.percentile(0.99) * 1.0e-3 << ','
+		<< r.latency.percentile(0.999) * 1.0e-3 << ','
+		<< r.latency.max() * 1.0e-3 << '\n';
+}
+
+} // namespace
+
+int
+main(int argc, char* argv[])
+{
+	Lab::BenchmarkConfiguration config;
+	config.mixWeights.assign(Lab::BenchmarkClient::NUM_REQUEST_KINDS, 0);
+	config.mixWeights[Lab::BenchmarkClient::REQUEST_SIGNAL] = 1;
+	std::string outputFile;
+
+	std::vector<const char*> positional;
+	for (int i = 1; i < argc; ++i) {
+		const char* arg = argv[i];
+		if (std::strncmp(arg, "--", 2) != 0) {
+			positional.push_back(arg);
+			continue;
+		}
+		if (i + 1 >= argc) {
+			printUsage(argv[0]);
+			return EXIT_FAILURE;
+		}
+		const char* value = argv[++i];
+		bool ok = true;
+		if (std::strcmp(arg, "--connections") == 0) {
+			ok = parseValue(value, 1U, static_cast<unsigned int>(MAX_CONNECTIONS), config.numConnections);
+		} else if (std::strcmp(arg, "--duration") == 0) {
+			ok = parseValue(value, 0.001, 1.0e6, config.duration);
+		} else if (std::strcmp(arg, "--mix") == 0) {
+			ok = parseMix(value, config.mixWeights);
+		} else if (std::strcmp(arg, "--pipeline") == 0) {
+			ok = parseValue(value, 1U, static_cast<unsigned int>(MAX_PIPELINE_DEPTH), config.pipelineDepth);
+		} else if (std::strcmp(arg, "--batch-frames") == 0) {
+			ok = parseValue(value, 1U, static_cast<unsigned int>(MAX_BATCH_FRAMES), config.batchFrames);
+		} else if (std::strcmp(arg, "--stream") == 0) {
+			config.stream = true;
+			ok = parseValue(value, 0.0f, 100000.0f, config.streamFrameRate);
+		} else if (std::strcmp(arg, "--options") == 0) {
+			ok = parseValue(value, 0U, 0xFFFFFFFFU, config.connectOptions);
+		} else if (std::strcmp(arg, "--output") == 0) {
+			outputFile = value;
+		} else {
+			ok = false;
+		}
+		if (!ok) {
+			std::cerr << "Invalid option: " << arg << ' ' << value << std::endl;
+			printUsage(argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+	if (positional.size() != 2 || !parseValue(positional[1], static_cast<unsigned short>(1),
+							static_cast<unsigned short>(65535), config.port)) {
+		printUsage(argv[0]);
+		return EXIT_FAILURE;
+	}
+	config.host = positional[0];
+
+	Lab::BenchmarkClient::Result total;
+	double elapsed;
+	try {
+		boost::asio::io_context ioContext;
+		std::vector<std::unique_ptr<Lab::BenchmarkClient>> clientList;
+		for (unsigned int i = 0; i < config.numConnections; ++i) {
+			clientList.push_back(std::make_unique<Lab::BenchmarkClient>(ioContext, config, i + 1));
+			clientList.back()->connect();
+		}
+
+		// All the clients start together.
+		const auto startTime = Lab::BenchmarkClient::Clock::now();
+		const auto endTime = startTime + std::chrono::duration_cast<Lab::BenchmarkClient::Clock::duration>(
+								std::chrono::duration<double>(config.duration));
+		std::vector<std::exception_ptr> exceptionList(config.numConnections);
+		std::vector<std::thread> threadList;
+		for (unsigned int i = 0; i < config.numConnections; ++i) {
+			threadList.emplace_back([&clientList, &exceptionList, endTime, i]() {
+				try {
+					clientList[i]->run(endTime);
+					clientList[i]->disconnect();
+				} catch (...) {
+					exceptionList[i] = std::current_exception();
+				}
+			});
+		}
+		for (auto& t : threadList) {
+			t.join();
+		}
+		elapsed = std::chrono::duration<double>(Lab::BenchmarkClient::Clock::now() - startTime).count();
+		for (auto& e : exceptionList) {
+			if (e) std::rethrow_exception(e);
+		}
+
+		for (const auto& client : clientList) {
+			for (int kind = 0; kind < Lab::BenchmarkClient::NUM_REQUEST_KINDS; ++kind) {
+				total[kind].add(client->result()[kind]);
+			}
+		}
+	} catch (std::exception& e) {
+		std::cerr << "Error: " << e.what() << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	std::ofstream file;
+	if (!outputFile.empty()) {
+		file.open(outputFile.c_str(), std::ios_base::app);
+		if (!file) {
+			std::cerr << "Could not open the file: " << outputFile << std::endl;
+			return EXIT_FAILURE;
+		}
+	}
+	std::ostream& out = outputFile.empty() ? std::cout : file;
+	if (outputFile.empty() || file.tellp() == 0) {
+		out << "kind,connections,duration_s,requests,frames,errors,requests_per_s,frames_per_s,mb_per_s,"
+			"p50_us,p99_us,p999_us,max_us\n";
+	}
+	out << std::fixed << std::setprecision(3);
+	Lab::BenchmarkClient::KindResult all;
+	for (int kind = 0; kind < Lab::BenchmarkClient::NUM_REQUEST_KINDS; ++kind) {
+		if (total[kind].requests + total[kind].errors == 0) continue;
+		writeCsvLine(out, Lab::BenchmarkClient::requestKindName(kind), config, elapsed, total[kind]);
+		all.add(total[kind]);
+	}
+	writeCsvLine(out, "all", config, elapsed, all);
+	out.flush();
+
+	return out ? EXIT_SUCCESS : EXIT_FAILURE;
+}
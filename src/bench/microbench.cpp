@@ -0,0 +1,329 @@
+/*
+
+  Copyright (c) 2013, 2017, 2018, 2019 Marcelo Y. Matuda.
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice,
+       this list of conditions and the following disclaimer.
+    2. Redistributions in binary form must reproduce the above copyright
+       notice, this list of conditions and the following disclaimer in the
+       documentation and/or other materials provided with the distribution.
+    3. Neither the name of the copyright holder nor the names of its
+       contributors may be used to endorse or promote products derived from
+       this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+  OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+  WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+  OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+  ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+// Microbenchmarks of the serialization kernels.
+//
+// Each kernel is compared with the element-by-element loop that it
+// replaced, and with memcpy of the same number of bytes (the memory
+// bandwidth limit). The results are checked against the old loops.
+// The noise of TestDevice is compared with the old std::minstd_rand loop;
+// the new noise is checked against the scalar reference, and for
+// reproducibility.
+// The vectorized 12-bit unpacking is compared with unpack12Reference(),
+// and the packing is checked by round trips, including odd and short
+// lengths.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include <boost/cstdint.hpp>
+
+#include "NoiseGenerator.h"
+#include "RawBuffer.h"
+#include "SamplePacking.h"
+
+#define NUM_REPETITIONS 21
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+// Median time (s).
+double
+measure(const std::function<void()>& f)
+{
+	std::vector<double> timeList;
+	for (int i = 0; i < NUM_REPETITIONS; ++i) {
+		const Clock::time_point t0 = Clock::now();
+		f();
+		timeList.push_back(std::chrono::duration<double>(Clock::now() - t0).count());
+	}
+	std::nth_element(timeList.begin(), timeList.begin() + NUM_REPETITIONS / 2, timeList.end());
+	return timeList[NUM_REPETITIONS / 2];
+}
+
+void
+report(const char* name, std::size_t size, double oldTime, double newTime, double memcpyTime)
+{
+	std::cout << std::left << std::setw(24) << name << std::right << std::fixed << std::setprecision(2)
+		<< std::setw(10) << size * 1.0e-6
+		<< std::setw(10) << size / oldTime * 1.0e-9
+		<< std::setw(10) << size / newTime * 1.0e-9
+		<< std::setw(10) << size / memcpyTime * 1.0e-9
+		<< std::setw(10) << oldTime / newTime << '\n';
+}
+
+// The element-by-element big-endian loops, as in RawBuffer before the kernels.
+
+void
+oldPutInt16Array(const boost::int16_t* a, std::size_t n, std::vector<boost::uint8_t>& buffer)
+{
+	std::size_t index = buffer.size();
+	buffer.resize(index + n * sizeof(boost::int16_t));
+	for (std::size_t j = 0; j < n; ++j) {
+		Lab::RawBuffer::storeInt16(a[j], &buffer[index], Lab::RawBuffer::BYTE_ORDER_BIG_ENDIAN);
+		index += sizeof(boost::int16_t);
+	}
+}
+
+void
+oldGetInt16Array(const std::vector<boost::uint8_t>& buffer, std::size_t n, boost::int16_t* a)
+{
+	std::size_t index = 0;
+	for (std::size_t j = 0; j < n; ++j) {
+		a[j] = Lab::RawBuffer::loadInt16(&buffer[index], Lab::RawBuffer::BYTE_ORDER_BIG_ENDIAN);
+		index += sizeof(boost::int16_t);
+	}
+}
+
+void
+oldPutFloatArray(const std::vector<float>& a, std::vector<boost::uint8_t>& buffer)
+{
+	std::size_t index = buffer.size();
+	buffer.resize(index + a.size() * sizeof(float));
+	union {
+		boost::uint32_t i;
+		float f;
+	};
+	for (std::size_t j = 0; j < a.size(); ++j) {
+		f = a[j];
+		buffer[index++] = i >> 24;
+		buffer[index++] = i >> 16;
+		buffer[index++] = i >> 8;
+		buffer[index++] = i;
+	}
+}
+
+void
+oldGetFloatArray(const std::vector<boost::uint8_t>& buffer, std::vector<float>& a)
+{
+	std::size_t index = 0;
+	union {
+		boost::uint32_t i;
+		float f;
+	};
+	for (std::size_t j = 0; j < a.size(); ++j) {
+		i = buffer[index++] << 24;
+		i += buffer[index++] << 16;
+		i += buffer[index++] << 8;
+		i += buffer[index++];
+		a[j] = f;
+	}
+}
+
+// The noise loop of TestDevice before NoiseGenerator.
+void
+oldAddNoise(const std::vector<float>& signal, std::minstd_rand& prngEngine,
+		std::uniform_real_distribution<float>& prngDist, boost::uint8_t* buffer)
+{
+	for (float value : signal) {
+		const boost::int16_t sample = static_cast<boost::int16_t>(std::round(value)) + prngDist(prngEngine);
+		Lab::RawBuffer::storeInt16(sample, buffer, Lab::RawBuffer::BYTE_ORDER_BIG_ENDIAN);
+		buffer += sizeof(boost::int16_t);
+	}
+}
+
+bool
+check(const char* name, bool ok)
+{
+	if (!ok) std::cerr << "Wrong result: " << name << std::endl;
+	return ok;
+}
+
+// samples: in the 12-bit range.
+bool
+checkPacking12(const std::vector<boost::int16_t>& samples, std::size_t n, Lab::RawBuffer::ByteOrder byteOrder)
+{
+	std::vector<boost::uint8_t> src(n * sizeof(boost::int16_t));
+	for (std::size_t i = 0; i < n; ++i) {
+		Lab::RawBuffer::storeInt16(samples[i], &src[i * sizeof(boost::int16_t)], byteOrder);
+	}
+	std::vector<boost::uint8_t> packed(Lab::SamplePacking::packed12Size(n));
+	Lab::SamplePacking::pack12(src.data(), n, byteOrder, packed.data());
+	std::vector<boost::int16_t> out(n);
+	Lab::SamplePacking::unpack12(packed.data(), n, out.data());
+	std::vector<boost::int16_t> referenceOut(n);
+	Lab::SamplePacking::unpack12Reference(packed.data(), n, referenceOut.data());
+	return out == referenceOut && std::equal(out.begin(), out.end(), samples.begin()) &&
+			(n % 2 == 0 || (packed[packed.size() - 1] == 0 && (packed[packed.size() - 2] & 0x0F) == 0));
+}
+
+} // namespace
+
+int
+main(int argc, char* argv[])
+{
+	// Default: one 4 MiB frame of int16 samples.
+	const std::size_t numSamples = (argc > 1) ? std::strtoul(argv[1], nullptr, 10) : 2 * 1024 * 1024;
+	if (numSamples == 0) {
+		std::cerr << "Usage: " << argv[0] << " [number of samples]" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	std::mt19937 prng(1);
+	std::uniform_int_distribution<int> intDist(-32768, 32767);
+	std::uniform_real_distribution<float> floatDist(-1.0f, 1.0f);
+	std::vector<boost::int16_t> samples(numSamples);
+	for (auto& s : samples) s = static_cast<boost::int16_t>(intDist(prng));
+	std::vector<float> floats(numSamples / 2);
+	for (auto& f : floats) f = floatDist(prng);
+	const std::size_t int16Size = numSamples * sizeof(boost::int16_t);
+	const std::size_t floatSize = floats.size() * sizeof(float);
+
+	Lab::RawBuffer rawBuffer; // big-endian
+	std::vector<boost::uint8_t> oldBuffer;
+	std::vector<boost::uint8_t> copyBuffer(std::max(int16Size, floatSize));
+	std::vector<boost::int16_t> samplesOut(numSamples);
+	std::vector<float> floatsOut(floats.size());
+	bool ok = true;
+
+	std::cout << "kernel                        MB  old GB/s  new GB/s  memcpy GB/s  speedup\n";
+
+	// putInt16Array
+	{
+		const double oldTime = measure([&]() { oldBuffer.clear(); oldPutInt16Array(samples.data(), numSamples, oldBuffer); });
+		const double newTime = measure([&]() { rawBuffer.reset(); rawBuffer.putInt16Array(samples.data(), numSamples); });
+		const double memcpyTime = measure([&]() { std::memcpy(copyBuffer.data(), samples.data(), int16Size); });
+		ok &= check("putInt16Array", std::memcmp(rawBuffer.data() + 4, oldBuffer.data(), int16Size) == 0);
+		report("putInt16Array", int16Size, oldTime, newTime, memcpyTime);
+	}
+	// getInt16Array
+	{
+		const double oldTime = measure([&]() { oldGetInt16Array(oldBuffer, numSamples, samplesOut.data()); });
+		const double newTime = measure([&]() {
+			rawBuffer.getInt16Array(samplesOut.data(), numSamples);
+			rawBuffer.reserve(rawBuffer.size()); // rewinds
+		});
+		const double memcpyTime = measure([&]() { std::memcpy(samplesOut.data(), copyBuffer.data(), int16Size); });
+		rawBuffer.reset();
+		rawBuffer.putInt16Array(samples.data(), numSamples);
+		rawBuffer.getInt16Array(samplesOut.data(), numSamples);
+		ok &= check("getInt16Array", samplesOut == samples);
+		report("getInt16Array", int16Size, oldTime, newTime, memcpyTime);
+	}
+	// putFloatArray
+	{
+		const double oldTime = measure([&]() { oldBuffer.clear(); oldPutFloatArray(floats, oldBuffer); });
+		const double newTime = measure([&]() { rawBuffer.reset(); rawBuffer.putFloatArray(floats); });
+		const double memcpyTime = measure([&]() { std::memcpy(copyBuffer.data(), floats.data(), floatSize); });
+		ok &= check("putFloatArray", std::memcmp(rawBuffer.data() + 4, oldBuffer.data(), floatSize) == 0);
+		report("putFloatArray", floatSize, oldTime, newTime, memcpyTime);
+	}
+	// getFloatArray
+	{
+		const double oldTime = measure([&]() { oldGetFloatArray(oldBuffer, floatsOut); });
+		const double newTime = measure([&]() {
+			rawBuffer.getFloatArray(floatsOut);
+			rawBuffer.reserve(rawBuffer.size()); // rewinds
+		});
+		const double memcpyTime = measure([&]() { std::memcpy(floatsOut.data(), copyBuffer.data(), floatSize); });
+		rawBuffer.reset();
+		rawBuffer.putFloatArray(floats);
+		rawBuffer.getFloatArray(floatsOut);
+		ok &= check("getFloatArray", floatsOut == floats);
+		report("getFloatArray", floatSize, oldTime, newTime, memcpyTime);
+	}
+	// Test device noise (the parameters of TestDevice), big-endian
+	{
+		std::vector<float> signal(numSamples);
+		std::vector<boost::int16_t> roundedSignal(numSamples);
+		for (std::size_t i = 0; i < numSamples; ++i) {
+			signal[i] = samples[i] * (1023.0f / 32768.0f);
+			roundedSignal[i] = static_cast<boost::int16_t>(std::round(signal[i]));
+		}
+		std::minstd_rand prngEngine;
+		std::uniform_real_distribution<float> prngDist(0.005f * -2048, 0.005f * 2047);
+		const Lab::NoiseGenerator noiseGenerator(0, -10, 10);
+		std::vector<boost::uint8_t> oldNoiseBuffer(int16Size);
+		std::vector<boost::uint8_t> noiseBuffer(int16Size);
+		boost::uint64_t frame = 0;
+		const double oldTime = measure([&]() { oldAddNoise(signal, prngEngine, prngDist, oldNoiseBuffer.data()); });
+		const double newTime = measure([&]() {
+			noiseGenerator.addTo(roundedSignal.data(), numSamples, frame++, 0,
+						Lab::RawBuffer::BYTE_ORDER_BIG_ENDIAN, noiseBuffer.data());
+		});
+		const double memcpyTime = measure([&]() { std::memcpy(copyBuffer.data(), samples.data(), int16Size); });
+
+		// Reproducible, the same for any split of the frame, and equal to the scalar reference.
+		const std::size_t split = std::min<std::size_t>(numSamples, 1001);
+		noiseGenerator.addTo(roundedSignal.data(), numSamples, 7, 0, Lab::RawBuffer::BYTE_ORDER_BIG_ENDIAN, noiseBuffer.data());
+		std::vector<boost::uint8_t> splitBuffer(int16Size);
+		noiseGenerator.addTo(roundedSignal.data() + split, numSamples - split, 7, split,
+					Lab::RawBuffer::BYTE_ORDER_BIG_ENDIAN, splitBuffer.data() + split * sizeof(boost::int16_t));
+		noiseGenerator.addTo(roundedSignal.data(), split, 7, 0, Lab::RawBuffer::BYTE_ORDER_BIG_ENDIAN, splitBuffer.data());
+		bool noiseOk = (splitBuffer == noiseBuffer);
+		for (std::size_t i = 0; i < numSamples; ++i) {
+			const boost::int16_t noise = noiseGenerator.value(7, i);
+			noiseOk &= (noise >= -10 && noise <= 10);
+			noiseOk &= (Lab::RawBuffer::loadInt16(&noiseBuffer[i * sizeof(boost::int16_t)], Lab::RawBuffer::BYTE_ORDER_BIG_ENDIAN) ==
+					roundedSignal[i] + noise);
+		}
+		ok &= check("noise", noiseOk);
+		report("noise", int16Size, oldTime, newTime, memcpyTime);
+	}
+
+	// 12-bit unpacking (old: unpack12Reference)
+	{
+		std::vector<boost::int16_t> samples12(numSamples);
+		for (std::size_t i = 0; i < numSamples; ++i) samples12[i] = samples[i] >> 4;
+		std::vector<boost::uint8_t> packed(Lab::SamplePacking::packed12Size(numSamples));
+		std::vector<boost::uint8_t> src(int16Size);
+		for (std::size_t i = 0; i < numSamples; ++i) {
+			Lab::RawBuffer::storeInt16(samples12[i], &src[i * sizeof(boost::int16_t)], Lab::RawBuffer::BYTE_ORDER_BIG_ENDIAN);
+		}
+		Lab::SamplePacking::pack12(src.data(), numSamples, Lab::RawBuffer::BYTE_ORDER_BIG_ENDIAN, packed.data());
+		const double oldTime = measure([&]() { Lab::SamplePacking::unpack12Reference(packed.data(), numSamples, samplesOut.data()); });
+		const double newTime = measure([&]() { Lab::SamplePacking::unpack12(packed.data(), numSamples, samplesOut.data()); });
+		const double memcpyTime = measure([&]() { std::memcpy(samplesOut.data(), copyBuffer.data(), int16Size); });
+
+		bool packingOk = true;
+		for (std::size_t n = 0; n <= std::min<std::size_t>(numSamples, 64); ++n) {
+			packingOk &= checkPacking12(samples12, n, Lab::RawBuffer::BYTE_ORDER_BIG_ENDIAN);
+			packingOk &= checkPacking12(samples12, n, Lab::RawBuffer::BYTE_ORDER_LITTLE_ENDIAN);
+		}
+		for (std::size_t n = numSamples - std::min<std::size_t>(numSamples, 3); n <= numSamples; ++n) {
+			packingOk &= checkPacking12(samples12, n, Lab::RawBuffer::BYTE_ORDER_BIG_ENDIAN);
+			packingOk &= checkPacking12(samples12, n, Lab::RawBuffer::BYTE_ORDER_LITTLE_ENDIAN);
+		}
+		ok &= check("pack12/unpack12", packingOk);
+		report("unpack12", int16Size, oldTime, newTime, memcpyTime);
+	}
+
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
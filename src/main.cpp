@@ -36,9 +36,17 @@
 
 #include "lzf_filter.h"
 #include "ParameterMap.h"
+#include "ServerConfiguration.h"
 #include "ServerWindow.h"
 
 #define CONFIG_FILE_NAME "/config-server.txt"
+#define MAX_SERVER_THREADS 256
+#define MAX_STATISTICS_LOG_PERIOD 86400
+#define MIN_SESSION_MEMORY_BUDGET_MB 16
+#define MAX_SESSION_MEMORY_BUDGET_MB 65536
+#define MIN_MAX_REQUEST_DATA_SIZE 1024
+#define MAX_MAX_REQUEST_DATA_SIZE (256 * 1024 * 1024)
+#define MAX_MAX_SESSIONS 65536
 
 
 
@@ -58,9 +66,43 @@ int main(int argc, char *argv[])
 	const Lab::ParameterMap pm(QString(configDir.c_str()) + CONFIG_FILE_NAME);
 	const std::string dataFile    = pm.value<std::string>("data_file");
 	const std::string datasetName = pm.value<std::string>("dataset_name");
+	Lab::ServerConfiguration config;
+	config.numThreads = pm.value<unsigned int>("server_threads", 1, MAX_SERVER_THREADS);
+	if (pm.contains("io_backend")) {
+		const std::string ioBackend = pm.value<std::string>("io_backend");
+		if (ioBackend == "io_uring") {
+			config.ioBackend = Lab::ServerConfiguration::IO_BACKEND_IO_URING;
+		} else if (ioBackend != "asio") {
+			std::cerr << "Invalid io_backend: " << ioBackend << std::endl;
+			return EXIT_FAILURE;
+		}
+	}
+	if (pm.contains("zero_copy_send_threshold")) {
+		config.zeroCopySendThreshold = pm.value<unsigned int>("zero_copy_send_threshold");
+	}
+	if (pm.contains("statistics_log_period")) {
+		config.statisticsLogPeriod = pm.value<unsigned int>("statistics_log_period", 0, MAX_STATISTICS_LOG_PERIOD);
+	}
+	if (pm.contains("metrics_file")) {
+		config.metricsFile = pm.value<std::string>("metrics_file");
+	}
+	if (pm.contains("metrics_socket")) {
+		config.metricsSocket = pm.value<std::string>("metrics_socket");
+	}
+	if (pm.contains("session_memory_budget")) {
+		config.sessionMemoryBudget = std::size_t(1024 * 1024) * pm.value<unsigned int>("session_memory_budget",
+						MIN_SESSION_MEMORY_BUDGET_MB, MAX_SESSION_MEMORY_BUDGET_MB);
+	}
+	if (pm.contains("max_request_data_size")) {
+		config.maxRequestDataSize = pm.value<unsigned int>("max_request_data_size",
+						MIN_MAX_REQUEST_DATA_SIZE, MAX_MAX_REQUEST_DATA_SIZE);
+	}
+	if (pm.contains("max_sessions")) {
+		config.maxSessions = pm.value<unsigned int>("max_sessions", 0, MAX_MAX_SESSIONS);
+	}
 
 	QApplication a(argc, argv);
-	Lab::ServerWindow w(dataFile, datasetName);
+	Lab::ServerWindow w(dataFile, datasetName, config);
 	w.show();
 	return a.exec();
 }
@@ -31,11 +31,14 @@
 
 #include "TestDevice.h"
 
+#include <algorithm> /* transform */
 #include <cmath>
 #include <vector>
 
 #include "HDF5Util.h"
 #include "Log.h"
+#include "Matrix.h"
+#include "RawBuffer.h"
 #include "Util.h"
 
 #define PAUSE_AFTER_SIGNAL_ACQ_MS 1
@@ -45,6 +48,7 @@
 #define MIN_SAMPLE_VALUE (-2048)
 #define SCALE (0.5f)
 #define NOISE_LEVEL (0.005f)
+#define NOISE_SEED 0
 
 
 
@@ -54,43 +58,104 @@ TestDevice::TestDevice(const std::string& dataFile, const std::string& datasetNa
 		: numActiveRxElem_()
 		, signalLength_()
 		, fs_()
-		, prngEngine_()
-		, prngDist_(NOISE_LEVEL * MIN_SAMPLE_VALUE, NOISE_LEVEL * MAX_SAMPLE_VALUE)
+		, signalByteOrder_(RawBuffer::BYTE_ORDER_BIG_ENDIAN)
+		, noiseGenerator_(NOISE_SEED,
+				static_cast<boost::int16_t>(NOISE_LEVEL * MIN_SAMPLE_VALUE),
+				static_cast<boost::int16_t>(NOISE_LEVEL * MAX_SAMPLE_VALUE))
+		, frameIndex_()
 {
 	LOG_DEBUG << "TestDevice()";
 	LOG_DEBUG << "dataFile=" << dataFile;
 	LOG_DEBUG << "datasetName=" << datasetName;
 
-	HDF5Util::load2(dataFile, datasetName, rawData_);
-	numActiveRxElem_ = rawData_.n1();
-	signalLength_ = rawData_.n2();
-	Util::normalize(rawData_);
+	auto rawData = std::make_shared<Matrix<float>>();
+	HDF5Util::load2(dataFile, datasetName, *rawData);
+	numActiveRxElem_ = rawData->n1();
+	signalLength_ = rawData->n2();
+	Util::normalize(*rawData);
 	const float factor = SCALE * MAX_SAMPLE_VALUE;
-	Util::multiply(rawData_, factor);
-	signalBuffer_.resize(rawData_.n1() * rawData_.n2());
+	Util::multiply(*rawData, factor);
+
+	auto signal = std::make_shared<std::vector<boost::int16_t>>(rawData->size());
+	std::transform(rawData->begin(), rawData->end(), signal->begin(),
+			[](float value) { return static_cast<boost::int16_t>(std::round(value)); });
+	signal_ = signal;
+}
+
+TestDevice::TestDevice(const TestDevice& baseDevice)
+		: numActiveRxElem_(baseDevice.numActiveRxElem_)
+		, signalLength_(baseDevice.signalLength_)
+		, fs_(baseDevice.fs_)
+		, signal_(baseDevice.signal_)
+		, signalByteOrder_(RawBuffer::BYTE_ORDER_BIG_ENDIAN)
+		, noiseGenerator_(baseDevice.noiseGenerator_)
+		, frameIndex_()
+{
+	LOG_DEBUG << "TestDevice(baseDevice)";
 }
 
 TestDevice::~TestDevice()
 {
 }
 
-const std::vector<boost::int16_t>&
-TestDevice::getSignal()
+void
+TestDevice::getSignal(boost::uint8_t* buffer)
 {
 	LOG_DEBUG << "getSignal()";
 
-	auto srcIter = rawData_.begin();
-	auto endSrcIter = rawData_.end();
-	auto destIter = signalBuffer_.begin();
-	while (srcIter != endSrcIter) {
-		*destIter = static_cast<boost::int16_t>(std::round(*srcIter)) + prngDist_(prngEngine_);
-		++srcIter;
-		++destIter;
+	convertSamples(0, signal_->size(), buffer);
+	++frameIndex_;
+}
+
+void
+TestDevice::getSignalRegion(boost::uint8_t* buffer, const std::vector<unsigned int>& channelList,
+				unsigned int firstSample, unsigned int numSamples)
+{
+	LOG_DEBUG << "getSignalRegion(): channels=" << channelList.size() << " first=" << firstSample << " n=" << numSamples;
+
+	if (firstSample > signalLength_ || numSamples > signalLength_ - firstSample) {
+		THROW_EXCEPTION(InvalidParameterException, "Invalid sample range.");
+	}
+	if (numSamples == 0) return;
+	for (unsigned int channel : channelList) {
+		if (channel >= numActiveRxElem_) {
+			THROW_EXCEPTION(InvalidParameterException, "Invalid channel: " << channel << '.');
+		}
+		buffer = convertSamples(std::size_t(channel) * signalLength_ + firstSample, numSamples, buffer);
+	}
+	++frameIndex_;
+}
+
+// Adds the noise of the current frame to the samples [firstIndex, firstIndex + numSamples) of signal_.
+// Returns the end of the written samples.
+boost::uint8_t*
+TestDevice::convertSamples(std::size_t firstIndex, std::size_t numSamples, boost::uint8_t* buffer)
+{
+	noiseGenerator_.addTo(&(*signal_)[firstIndex], numSamples, frameIndex_, firstIndex, signalByteOrder_, buffer);
+	return buffer + numSamples * sizeof(boost::int16_t);
+}
+
+void
+TestDevice::getSignalBatch(boost::uint8_t* buffer, unsigned int numFrames)
+{
+	LOG_DEBUG << "getSignalBatch(): " << numFrames;
+
+	const std::size_t frameSize = signal_->size() * sizeof(boost::int16_t);
+	for (unsigned int i = 0; i < numFrames; ++i, buffer += frameSize) {
+		getSignal(buffer);
 	}
+}
 
-	Util::sleepMs(PAUSE_AFTER_SIGNAL_ACQ_MS);
+std::size_t
+TestDevice::getSignalBufferSize() const
+{
+	return signal_->size();
+}
 
-	return signalBuffer_;
+unsigned int
+TestDevice::getAcquisitionPauseMs() const
+{
+	return PAUSE_AFTER_SIGNAL_ACQ_MS;
 }
 
 boost::uint32_t
@@ -32,14 +32,15 @@
 #ifndef TESTDEVICE_H_
 #define TESTDEVICE_H_
 
-#include <random>
+#include <memory>
 #include <string>
 #include <vector>
 
 #include <boost/cstdint.hpp>
 
 #include "Exception.h"
-#include "Matrix.h"
+#include "NoiseGenerator.h"
+#include "RawBuffer.h"
 
 
 
@@ -50,9 +51,24 @@ struct TestDeviceException : public virtual Exception {};
 class TestDevice {
 public:
 	TestDevice(const std::string& dataFile, const std::string& datasetName);
+	// The signal data are shared with baseDevice (read-only).
+	TestDevice(const TestDevice& baseDevice);
 	~TestDevice();
 
-	const std::vector<boost::int16_t>& getSignal();
+	// Writes getSignalBufferSize() int16 samples to buffer, in the byte order
+	// set by setSignalByteOrder() (default: big-endian).
+	// Each call acquires a new frame: the noise depends on the frame index
+	// (see NoiseGenerator), and is the same in every run.
+	void getSignal(boost::uint8_t* buffer);
+	// Writes numFrames consecutive signals (numFrames * getSignalBufferSize() samples).
+	void getSignalBatch(boost::uint8_t* buffer, unsigned int numFrames);
+	// Writes the samples [firstSample, firstSample + numSamples) of each channel in channelList.
+	void getSignalRegion(boost::uint8_t* buffer, const std::vector<unsigned int>& channelList,
+				unsigned int firstSample, unsigned int numSamples);
+	std::size_t getSignalBufferSize() const;
+	void setSignalByteOrder(RawBuffer::ByteOrder byteOrder) { signalByteOrder_ = byteOrder; }
+	// Emulated acquisition time of one signal. The caller waits, without blocking the thread.
+	unsigned int getAcquisitionPauseMs() const;
 	boost::uint32_t getSignalLength() const;
 	boost::int16_t getMaxSampleValue() const;
 	boost::int16_t getMinSampleValue() const;
@@ -74,16 +90,18 @@ public:
 	void execPostLoopConfiguration();
 
 private:
-	TestDevice(const TestDevice&) = delete;
 	TestDevice& operator=(const TestDevice&) = delete;
 
+	boost::uint8_t* convertSamples(std::size_t firstIndex, std::size_t numSamples, boost::uint8_t* buffer);
+
 	unsigned int numActiveRxElem_;
 	unsigned int signalLength_;
 	float fs_;
-	Matrix<float> rawData_;
-	std::vector<boost::int16_t> signalBuffer_;
-	std::minstd_rand prngEngine_;
-	std::uniform_real_distribution<float> prngDist_;
+	// Rounded samples, without noise. Channel-major.
+	std::shared_ptr<const std::vector<boost::int16_t>> signal_;
+	RawBuffer::ByteOrder signalByteOrder_;
+	NoiseGenerator noiseGenerator_;
+	boost::uint64_t frameIndex_;
 };
 
 } // namespace Lab
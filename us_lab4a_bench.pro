@@ -0,0 +1,40 @@
+# Load generator / benchmark client for us_lab4a_test_server.
+
+CONFIG -= qt app_bundle
+CONFIG += c++14 warn_on console
+
+TARGET = us_lab4a_bench
+TEMPLATE = app
+
+SOURCES += \
+    src/bench/main.cpp \
+    src/bench/BenchmarkClient.cpp \
+    src/MessageStatistics.cpp
+
+HEADERS += \
+    src/ArrayAcqProtocol.h \
+    src/ByteSwap.h \
+    src/LatencyHistogram.h \
+    src/MessageStatistics.h \
+    src/RawBuffer.h \
+    src/RawBufferPool.h \
+    src/bench/BenchmarkClient.h \
+    src/util/Exception.h
+
+LIBS += -lboost_system \
+    -lpthread
+
+INCLUDEPATH += \
+    src \
+    src/bench \
+    src/util
+
+DEPENDPATH += \
+    src \
+    src/bench \
+    src/util
+
+QMAKE_CXXFLAGS_DEBUG = -march=native -O0 -g
+QMAKE_CXXFLAGS_RELEASE = -march=native -O3
+
+OBJECTS_DIR = tmp/bench
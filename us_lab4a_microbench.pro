@@ -0,0 +1,31 @@
+# Microbenchmarks of the serialization kernels, the 12-bit packing and the test device noise.
+
+CONFIG -= qt app_bundle
+CONFIG += c++14 warn_on console
+
+TARGET = us_lab4a_microbench
+TEMPLATE = app
+
+SOURCES += \
+    src/bench/microbench.cpp
+
+HEADERS += \
+    src/ByteSwap.h \
+    src/NoiseGenerator.h \
+    src/SamplePacking.h \
+    src/RawBuffer.h \
+    src/RawBufferPool.h \
+    src/util/Exception.h
+
+INCLUDEPATH += \
+    src \
+    src/util
+
+DEPENDPATH += \
+    src \
+    src/util
+
+QMAKE_CXXFLAGS_DEBUG = -march=native -O0 -g
+QMAKE_CXXFLAGS_RELEASE = -march=native -O3
+
+OBJECTS_DIR = tmp/microbench
@@ -10,10 +10,17 @@ CONFIG += c++14 warn_on
 
 SOURCES += \
     src/main.cpp \
+    src/IoUring.cpp \
     src/LogSyntaxHighlighter.cpp \
+    src/MessageStatistics.cpp \
+    src/ServerStatistics.cpp \
     src/ServerThread.cpp \
     src/ServerWindow.cpp \
+    src/SharedMemoryRing.cpp \
+    src/SignalCompressor.cpp \
+    src/SignalDecimator.cpp \
     src/test/TestDevice.cpp \
+    src/util/AllocationCounter.cpp \
     src/util/HDF5Util.cpp \
     src/util/KeyValueFileReader.cpp \
     src/util/Log.cpp \
@@ -26,11 +33,25 @@ HEADERS += \
     src/ArrayAcqProtocol.h \
     src/ArrayAcqServer.h \
     src/ArrayAcqServerProtocol.h \
+    src/ArrayAcqServerSession.h \
+    src/ByteSwap.h \
+    src/IoUring.h \
+    src/LatencyHistogram.h \
     src/LogSyntaxHighlighter.h \
+    src/MessageStatistics.h \
+    src/NoiseGenerator.h \
     src/RawBuffer.h \
+    src/RawBufferPool.h \
+    src/SamplePacking.h \
+    src/ServerConfiguration.h \
+    src/ServerStatistics.h \
     src/ServerThread.h \
     src/ServerWindow.h \
+    src/SharedMemoryRing.h \
+    src/SignalCompressor.h \
+    src/SignalDecimator.h \
     src/test/TestDevice.h \
+    src/util/AllocationCounter.h \
     src/util/Exception.h \
     src/util/HDF5Util.h \
     src/util/KeyValueFileReader.h \
@@ -46,6 +67,8 @@ FORMS += \
     ui/ServerWindow.ui
 
 LIBS += -lboost_system \
+    -lpthread \
+    -lrt \
     -lhdf5_cpp
 
 exists(/usr/include/hdf5/serial) {